@@ -10,5 +10,8 @@ public class SurvivalGameTarget : TargetRules
 		Type = TargetType.Game;
 
 		ExtraModuleNames.AddRange( new string[] { "SurvivalGame" } );
+
+		// Push model replication is compiled out unless the target asks for it, which would turn every MARK_PROPERTY_DIRTY into a no-op
+		bWithPushModel = true;
 	}
 }
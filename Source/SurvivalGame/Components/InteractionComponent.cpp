@@ -4,23 +4,22 @@
 #include "SurvivalGame/Components/InteractionComponent.h"
 #include "SurvivalGame/Widgets/InteractionWidget.h"
 #include "SurvivalGame/Player/SurvivalCharacter.h"
+#include "SurvivalGame/Player/SurvivalPlayerController.h"
+#include "Components/PrimitiveComponent.h"
+#include "SurvivalGame/World/InteractionSubsystem.h"
 
 UInteractionComponent::UInteractionComponent()
 {
-	SetComponentTickEnabled(false);
+	PrimaryComponentTick.bCanEverTick = false;
 
 	InteractionTime = 0.f;
 	InteractionDistance = 200.f;
 	InteractableNameText = FText::FromString("Interactable Object");
 	InteractableActionText = FText::FromString("Interact");
 	bAllowMultipleInteractors = true;
-
-	Space = EWidgetSpace::Screen;
-	DrawSize = FIntPoint(600, 100);
-	bDrawAtDesiredSize = true;
+	bHighlightPrimitivesCached = false;
 
 	SetActive(true);
-	SetHiddenInGame(true);
 }
 
 void UInteractionComponent::SetInteractableNameText(const FText& NewNameText)
@@ -35,10 +34,68 @@ void UInteractionComponent::SetInteractableActionText(const FText& NewActionText
 	RefreshWidget();
 }
 
+void UInteractionComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (IsActive())
+	{
+		if (UInteractionSubsystem* InteractionSubsystem = GetWorld()->GetSubsystem<UInteractionSubsystem>())
+		{
+			InteractionSubsystem->RegisterInteractable(this);
+		}
+	}
+}
+
+void UInteractionComponent::OnUnregister()
+{
+	//Covers being destroyed as well as streamed out
+	if (UWorld* World = GetWorld())
+	{
+		if (UInteractionSubsystem* InteractionSubsystem = World->GetSubsystem<UInteractionSubsystem>())
+		{
+			InteractionSubsystem->UnregisterInteractable(this);
+		}
+	}
+
+	Super::OnUnregister();
+}
+
+void UInteractionComponent::Activate(bool bReset /*= false*/)
+{
+	Super::Activate(bReset);
+
+	if (IsActive() && HasBegunPlay())
+	{
+		if (UInteractionSubsystem* InteractionSubsystem = GetWorld()->GetSubsystem<UInteractionSubsystem>())
+		{
+			InteractionSubsystem->RegisterInteractable(this);
+		}
+	}
+}
+
+void UInteractionComponent::OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport /*= ETeleportType::None*/)
+{
+	Super::OnUpdateTransform(UpdateTransformFlags, Teleport);
+
+	if (IsActive() && HasBegunPlay())
+	{
+		if (UInteractionSubsystem* InteractionSubsystem = GetWorld()->GetSubsystem<UInteractionSubsystem>())
+		{
+			InteractionSubsystem->UpdateInteractable(this);
+		}
+	}
+}
+
 void UInteractionComponent::Deactivate()
 {
 	Super::Deactivate();
 
+	if (UInteractionSubsystem* InteractionSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UInteractionSubsystem>() : nullptr)
+	{
+		InteractionSubsystem->UnregisterInteractable(this);
+	}
+
 	for (int32 i = Interactors.Num() - 1; i >= 0; --i)
 	{
 		if (ASurvivalCharacter* Interactor = Interactors[i])
@@ -59,10 +116,68 @@ bool UInteractionComponent::CanInteract(class ASurvivalCharacter* Character) con
 
 void UInteractionComponent::RefreshWidget()
 {
-	//Make sure the widget is initialized, and that we are displaying the right values (these may have changed)
-	if (UInteractionWidget* InteractionWidget = Cast<UInteractionWidget>(GetUserWidgetObject()))
+	//Make sure the prompt is displaying the right values if it's showing us (these may have changed)
+	if (GetNetMode() == NM_DedicatedServer)
 	{
-		InteractionWidget->UpdateInteractionWidget(this);
+		return;
+	}
+
+	TArray<ASurvivalPlayerController*, TInlineAllocator<2>> LocalPCs;
+
+	auto AddLocalPC = [&LocalPCs](const ASurvivalCharacter* Character)
+	{
+		if (Character && Character->IsLocallyControlled())
+		{
+			if (ASurvivalPlayerController* PC = Cast<ASurvivalPlayerController>(Character->GetController()))
+			{
+				LocalPCs.AddUnique(PC);
+			}
+		}
+	};
+
+	for (const ASurvivalCharacter* Interactor : Interactors)
+	{
+		AddLocalPC(Interactor);
+	}
+
+	for (const TWeakObjectPtr<ASurvivalCharacter>& Focuser : LocalFocusers)
+	{
+		AddLocalPC(Focuser.Get());
+	}
+
+	for (ASurvivalPlayerController* PC : LocalPCs)
+	{
+		PC->RefreshInteractionPrompt(this);
+	}
+}
+
+void UInteractionComponent::RefreshHighlightPrimitives()
+{
+	HighlightPrimitives.Reset();
+
+	TInlineComponentArray<UPrimitiveComponent*> Primitives(GetOwner());
+
+	for (UPrimitiveComponent* Prim : Primitives)
+	{
+		HighlightPrimitives.Add(Prim);
+	}
+
+	bHighlightPrimitivesCached = true;
+}
+
+void UInteractionComponent::SetHighlighted(const bool bHighlighted)
+{
+	if (!bHighlightPrimitivesCached)
+	{
+		RefreshHighlightPrimitives();
+	}
+
+	for (const TWeakObjectPtr<UPrimitiveComponent>& Prim : HighlightPrimitives)
+	{
+		if (Prim.IsValid())
+		{
+			Prim->SetRenderCustomDepth(bHighlighted);
+		}
 	}
 }
 
@@ -77,34 +192,29 @@ void UInteractionComponent::BeginFocus(class ASurvivalCharacter* Character)
 
 	if (GetNetMode() != NM_DedicatedServer)
 	{
-		SetHiddenInGame(false);
+		SetHighlighted(true);
 
-		for (auto& VisualComp : GetOwner()->GetComponentsByClass(UPrimitiveComponent::StaticClass()))
+		if (ASurvivalPlayerController* PC = Character->IsLocallyControlled() ? Cast<ASurvivalPlayerController>(Character->GetController()) : nullptr)
 		{
-			if (UPrimitiveComponent* Prim = Cast<UPrimitiveComponent>(VisualComp))
-			{
-				Prim->SetRenderCustomDepth(true);
-			}
+			LocalFocusers.AddUnique(Character);
+			PC->ShowInteractionPrompt(this);
 		}
 	}
-
-	RefreshWidget();
 }
 
 void UInteractionComponent::EndFocus(class ASurvivalCharacter* Character)
 {
 	OnEndFocus.Broadcast(Character);
 
-	if (GetNetMode() != NM_DedicatedServer)
+	LocalFocusers.RemoveAll([Character](const TWeakObjectPtr<ASurvivalCharacter>& Focuser) { return !Focuser.IsValid() || Focuser.Get() == Character; });
+
+	if (GetNetMode() != NM_DedicatedServer && GetOwner())
 	{
-		SetHiddenInGame(true);
+		SetHighlighted(false);
 
-		for (auto& VisualComp : GetOwner()->GetComponentsByClass(UPrimitiveComponent::StaticClass()))
+		if (ASurvivalPlayerController* PC = Character && Character->IsLocallyControlled() ? Cast<ASurvivalPlayerController>(Character->GetController()) : nullptr)
 		{
-			if (UPrimitiveComponent* Prim = Cast<UPrimitiveComponent>(VisualComp))
-			{
-				Prim->SetRenderCustomDepth(false);
-			}
+			PC->HideInteractionPrompt(this);
 		}
 	}
 }
@@ -3,7 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
-#include "Components/WidgetComponent.h"
+#include "Components/SceneComponent.h"
 #include "InteractionComponent.generated.h"
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnBeginInteract, class ASurvivalCharacter*, Character);
@@ -13,10 +13,11 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnEndFocus, class ASurvivalCharacte
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnInteract, class ASurvivalCharacter*, Character);
 
 /**
- * 
+ * Makes its owner something players can look at and interact with. This is only a point in the world with some settings;
+ * the prompt is a single widget owned by the local player controller, shown for whatever the player is focused on.
  */
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
-class SURVIVALGAME_API UInteractionComponent : public UWidgetComponent
+class SURVIVALGAME_API UInteractionComponent : public USceneComponent
 {
 	GENERATED_BODY()
 	
@@ -76,21 +77,39 @@ public:
 
 protected:
 	// Called when the game starts
+	virtual void BeginPlay() override;
+	virtual void OnUnregister() override;
+
+	//Active interactables are kept in the world's interaction subsystem, so they can be found without tracing for them
+	virtual void Activate(bool bReset = false) override;
 	virtual void Deactivate() override;
+	virtual void OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport = ETeleportType::None) override;
 
 	bool CanInteract(class ASurvivalCharacter* Character) const;
 
+	//The owner's primitives that get outlined while focused. Gathered the first time we're focused
+	TArray<TWeakObjectPtr<class UPrimitiveComponent>> HighlightPrimitives;
+	bool bHighlightPrimitivesCached;
+
+	void SetHighlighted(const bool bHighlighted);
+
 	//On the server, this will hold all interactors. On the local player, this will just hold the local player (provided they are an interactor)
 	UPROPERTY()
 		TArray<class ASurvivalCharacter*> Interactors;
 
+	//Locally controlled characters currently focusing us, so prompt refreshes only reach the players looking at this interactable
+	TArray<TWeakObjectPtr<class ASurvivalCharacter>> LocalFocusers;
+
 public:
 
-	/***Refresh the interaction widget and its custom widgets.
+	/***Refresh the interaction prompt if it's showing this interactable.
 	An example of when we'd use this is when we take 3 items out of a stack of 10, and we need to update the widget
 	so it shows the stack as having 7 items left. */
 	void RefreshWidget();
 
+	//Gather the owner's primitives for highlighting again. Call this if the owner adds or removes visual components at runtime
+	void RefreshHighlightPrimitives();
+
 	//Called on the client when the players interaction check trace begins/ends hitting this item
 	void BeginFocus(class ASurvivalCharacter* Character);
 	void EndFocus(class ASurvivalCharacter* Character);
@@ -4,29 +4,317 @@
 #include "SurvivalGame/Components/InventoryComponent.h"
 #include "Net/UnrealNetwork.h"
 #include "Engine/ActorChannel.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetConnection.h"
+#include "Engine/PackageMapClient.h"
+#include "Net/Core/Misc/NetConditionGroupManager.h"
+#include "GameFramework/PlayerController.h"
+#include "SurvivalGame/Player/SurvivalCharacter.h"
 #include  "SurvivalGame/Items/Item.h"
+#include "SurvivalGame/Items/AmmoItem.h"
+#include "SurvivalGame/Items/EquippableItem.h"
+#include "SurvivalGame/Items/GearItem.h"
+#include "SurvivalGame/Items/WeaponItem.h"
+#include "SurvivalGame/Items/ThrowableItem.h"
+#include "Engine/World.h"
+#include "TimerManager.h"
 
 #define LOCTEXT_NAMESPACE "Inventory"
 
+#if !UE_BUILD_SHIPPING
+static TAutoConsoleVariable<int32> CVarCheckInventoryTotals(
+	TEXT("Survival.Inventory.CheckTotals"),
+	0,
+	TEXT("If non zero, inventories recalculate their weight and item count after every change and ensure the running totals match."),
+	ECVF_Cheat);
+#endif
+
+void FInventoryItemEntry::PreReplicatedRemove(const FInventoryItemList& InArraySerializer)
+{
+	if (InArraySerializer.OwnerComponent && Item)
+	{
+		InArraySerializer.OwnerComponent->OnEntryRemoved(Item);
+	}
+}
+
+void FInventoryItemEntry::PostReplicatedAdd(const FInventoryItemList& InArraySerializer)
+{
+	//The item subobject may not have arrived yet, in which case PostReplicatedChange picks it up once it does
+	if (InArraySerializer.OwnerComponent && Item && Item->OwningInventory != InArraySerializer.OwnerComponent)
+	{
+		InArraySerializer.OwnerComponent->OnEntryAdded(Item);
+	}
+}
+
+void FInventoryItemEntry::PostReplicatedChange(const FInventoryItemList& InArraySerializer)
+{
+	if (InArraySerializer.OwnerComponent && Item && Item->OwningInventory != InArraySerializer.OwnerComponent)
+	{
+		InArraySerializer.OwnerComponent->OnEntryAdded(Item);
+	}
+}
+
+void FInventoryItemList::PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters)
+{
+	//One UI refresh per received update, no matter how many entries changed
+	if (OwnerComponent)
+	{
+		OwnerComponent->OnInventoryUpdated.Broadcast();
+	}
+}
+
+float FItemInstance::GetStackWeight() const
+{
+	const UItem* ItemCDO = ItemClass ? ItemClass->GetDefaultObject<UItem>() : nullptr;
+	return ItemCDO ? Quantity * ItemCDO->Weight : 0.f;
+}
+
+void FItemInstance::SyncProxy()
+{
+	if (Proxy && Proxy->Quantity != Quantity)
+	{
+		Proxy->Quantity = Quantity;
+		Proxy->OnItemModified.Broadcast();
+	}
+}
+
+void FItemInstance::PreReplicatedRemove(const FItemInstanceList& InArraySerializer)
+{
+	if (Proxy)
+	{
+		Proxy->InstanceInventory = nullptr;
+	}
+}
+
+void FItemInstance::PostReplicatedChange(const FItemInstanceList& InArraySerializer)
+{
+	SyncProxy();
+}
+
+void FItemInstanceList::PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters)
+{
+	if (OwnerComponent)
+	{
+		OwnerComponent->RefreshInstanceTotals();
+		OwnerComponent->OnInventoryUpdated.Broadcast();
+	}
+}
+
+/**Only the owner and players looting the inventory get its item list, everyone else is sent nothing and just sees PublicNumItems.
+The items themselves are filtered by their subobject condition, see RefreshItemReplicationCondition()*/
+static bool ShouldSerializeItemsFor(const UInventoryComponent* Inventory, const FNetDeltaSerializeInfo& DeltaParms)
+{
+	if (!DeltaParms.Writer || !Inventory)
+	{
+		return true;
+	}
+
+	UPackageMapClient* PackageMap = Cast<UPackageMapClient>(DeltaParms.Map);
+	return !PackageMap || Inventory->ShouldReplicateItemsTo(PackageMap->GetConnection());
+}
+
+bool FInventoryItemList::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	//Skipping a connection leaves its last acked state alone, so it gets everything it missed once it's allowed to see the items
+	if (!ShouldSerializeItemsFor(OwnerComponent, DeltaParms))
+	{
+		return false;
+	}
+
+	return FFastArraySerializer::FastArrayDeltaSerialize<FInventoryItemEntry, FInventoryItemList>(Entries, DeltaParms, *this);
+}
+
+bool FItemInstanceList::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	if (!ShouldSerializeItemsFor(OwnerComponent, DeltaParms))
+	{
+		return false;
+	}
+
+	return FFastArraySerializer::FastArrayDeltaSerialize<FItemInstance, FItemInstanceList>(Instances, DeltaParms, *this);
+}
+
 // Sets default values for this component's properties
 UInventoryComponent::UInventoryComponent()
 {
 	//OnItemAdded.AddDynamic(this, &UInventoryComponent::ItemAdded);
 	//OnItemRemoved.AddDynamic(this, &UInventoryComponent::ItemRemoved);
 
+	Items.OwnerComponent = this;
+	ItemInstances.OwnerComponent = this;
+
+	bUseItemInstances = false;
+
+	CurrentWeight = 0.0;
+	NumItems = 0;
+	InstanceWeight = 0.0;
+	NumInstances = 0;
+	PublicNumItems = 0;
+	ItemReplicationCondition = COND_OwnerOnly;
+	LooterNetGroup = FName(TEXT("InventoryLooters"), GetUniqueID());
+	OwnerDormancyBeforeLooting = DORM_Never;
+
+	//Items are registered as replicated subobjects as they're added and removed, rather than walked every time we replicate
+	bReplicateUsingRegisteredSubObjectList = true;
 	SetIsReplicated(true);
 }
 
 FItemAddResult UInventoryComponent::TryAddItem(UItem* Item)
 {
-	return TryAddItem_Internal(Item);
+	if (Item)
+	{
+		return TryAddItem_Internal(Item, Item->GetQuantity());
+	}
+	return FItemAddResult::AddedNone(0, LOCTEXT("InvalidItemText", "Couldn't add item to inventory."));
 }
 
 FItemAddResult UInventoryComponent::TryAddItemFromClass(TSubclassOf<class UItem> ItemClass, const int32 Quantity)
 {
-	UItem* Item = NewObject<UItem>(GetOwner(), ItemClass);
-	Item->SetQuantity(Quantity);
-	return TryAddItem_Internal(Item);
+	//No need to create an item just to check if it fits, the class defaults have everything we need
+	if (const UItem* ItemCDO = ItemClass ? ItemClass->GetDefaultObject<UItem>() : nullptr)
+	{
+		const int32 AddQuantity = FMath::Clamp(Quantity, 0, ItemCDO->bStackable ? ItemCDO->MaxStackSize : 1);
+
+		if (bUseItemInstances)
+		{
+			return TryAddInstance_Internal(ItemCDO, AddQuantity);
+		}
+
+		return TryAddItem_Internal(ItemCDO, AddQuantity);
+	}
+	return FItemAddResult::AddedNone(Quantity, LOCTEXT("InvalidItemText", "Couldn't add item to inventory."));
+}
+
+FItemAddResult UInventoryComponent::TryMoveItem(UItem* Item)
+{
+	if (Item && Item->OwningInventory != this)
+	{
+		return TryAddItem_Internal(Item, Item->GetQuantity(), nullptr, Item);
+	}
+	return FItemAddResult::AddedNone(0, LOCTEXT("InvalidItemText", "Couldn't add item to inventory."));
+}
+
+TArray<FItemAddResult> UInventoryComponent::TryAddItems(const TArray<FItemAddRequest>& Requests, const bool bAllOrNothing)
+{
+	TArray<FItemAddResult> Results;
+
+	if (!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return Results;
+	}
+
+	Results.Reserve(Requests.Num());
+
+	//What each add changed, so the batch can be undone if it has to be all or nothing
+	struct FAddUndo
+	{
+		UItem* Item;
+		int32 OldQuantity;
+	};
+	TArray<FAddUndo, TInlineAllocator<16>> UndoLog;
+
+	//Item instances are plain structs, so just keep a copy of them to go back to
+	TArray<FItemInstance> OldInstances;
+	const double OldInstanceWeight = InstanceWeight;
+	const int32 OldNumInstances = NumInstances;
+	bool bInstancesChanged = false;
+
+	if (bUseItemInstances && bAllOrNothing)
+	{
+		OldInstances = ItemInstances.Instances;
+	}
+
+	bool bItemsChanged = false;
+	int32 FailedIndex = INDEX_NONE;
+
+	for (const FItemAddRequest& Request : Requests)
+	{
+		const UItem* ItemCDO = Request.ItemClass ? Request.ItemClass->GetDefaultObject<UItem>() : nullptr;
+
+		if (!ItemCDO)
+		{
+			Results.Add(FItemAddResult::AddedNone(Request.Quantity, LOCTEXT("InvalidItemText", "Couldn't add item to inventory.")));
+		}
+		else if (bUseItemInstances)
+		{
+			Results.Add(TryAddInstance_Internal(ItemCDO, FMath::Clamp(Request.Quantity, 0, ItemCDO->bStackable ? ItemCDO->MaxStackSize : 1)));
+			bInstancesChanged |= Results.Last().AmountGiven > 0;
+		}
+		else
+		{
+			UItem* AddedTo = nullptr;
+			Results.Add(TryAddItem_Internal(ItemCDO, FMath::Clamp(Request.Quantity, 0, ItemCDO->bStackable ? ItemCDO->MaxStackSize : 1), &AddedTo));
+
+			if (AddedTo && Results.Last().AmountGiven > 0)
+			{
+				//A new item starts with just the amount given, so an old quantity of zero means we created it
+				UndoLog.Add({ AddedTo, AddedTo->GetQuantity() - Results.Last().AmountGiven });
+				bItemsChanged = true;
+			}
+		}
+
+		if (bAllOrNothing && Results.Last().Result != EItemAddResult::IAR_AllItemsAdded)
+		{
+			FailedIndex = Results.Num() - 1;
+			break;
+		}
+	}
+
+	if (FailedIndex != INDEX_NONE)
+	{
+		//Undo in reverse, so stacks that were topped up more than once go back to where they started
+		for (int32 i = UndoLog.Num() - 1; i >= 0; --i)
+		{
+			UItem* Item = UndoLog[i].Item;
+
+			if (UndoLog[i].OldQuantity > 0)
+			{
+				Item->SetQuantity(UndoLog[i].OldQuantity);
+			}
+			else
+			{
+				//Adding an equippable might have auto equipped it
+				if (UEquippableItem* EquippableItem = Cast<UEquippableItem>(Item))
+				{
+					if (EquippableItem->IsEquipped())
+					{
+						EquippableItem->SetEquipped(false);
+					}
+				}
+
+				RemoveEntry(Item);
+			}
+		}
+
+		if (bInstancesChanged)
+		{
+			ItemInstances.Instances = MoveTemp(OldInstances);
+			ItemInstances.MarkArrayDirty();
+			InstanceWeight = OldInstanceWeight;
+			NumInstances = OldNumInstances;
+
+			for (FItemInstance& Instance : ItemInstances.Instances)
+			{
+				Instance.SyncProxy();
+			}
+		}
+
+		const FText ErrorText = Results[FailedIndex].ErrorText;
+		Results.Reset();
+
+		for (const FItemAddRequest& Request : Requests)
+		{
+			Results.Add(FItemAddResult::AddedNone(Request.Quantity, ErrorText));
+		}
+	}
+
+	//Tell the UI once for the whole batch
+	if (bItemsChanged || bInstancesChanged)
+	{
+		OnInventoryUpdated.Broadcast();
+	}
+
+	return Results;
 }
 
 int32 UInventoryComponent::ConsumeItem(class UItem* Item)
@@ -42,6 +330,17 @@ int32 UInventoryComponent::ConsumeItem(class UItem* Item, const int32 Quantity)
 {
 	if (GetOwner() && GetOwner()->HasAuthority() && Item)
 	{
+		//Changing a stand in does nothing, so turn the instance it stands in for into a real item first
+		if (Item->InstanceInventory == this)
+		{
+			Item = MaterializeInstance(Item->InstanceID);
+
+			if (!Item)
+			{
+				return 0;
+			}
+		}
+
 		const int32 RemoveQuantity = FMath::Min(Quantity, Item->GetQuantity());
 
 		//We shouldn't have a negative amount of the item after the drop
@@ -54,10 +353,6 @@ int32 UInventoryComponent::ConsumeItem(class UItem* Item, const int32 Quantity)
 		{
 			RemoveItem(Item);
 		}
-		else
-		{
-			ClientRefreshInventory();
-		}
 
 		return RemoveQuantity;
 	}
@@ -69,12 +364,16 @@ bool UInventoryComponent::RemoveItem(UItem* Item)
 {
 	if (GetOwner() && GetOwner()->HasAuthority())
 	{
+		if (Item && Item->InstanceInventory == this)
+		{
+			Item = MaterializeInstance(Item->InstanceID);
+		}
+
 		if (Item)
 		{
-			Items.RemoveSingle(Item);
-			OnItemRemoved.Broadcast(Item);
+			RemoveEntry(Item);
 
-			ReplicatedItemsKey++;
+			OnItemRemoved.Broadcast(Item);
 
 			return true;
 		}
@@ -85,68 +384,239 @@ bool UInventoryComponent::RemoveItem(UItem* Item)
 
 bool UInventoryComponent::HasItem(TSubclassOf<class UItem> ItemClass, const int32 Quantity) const
 {
-	if (UItem* ItemToFind = FindItemByClass(ItemClass))
+	if (const auto* ClassItems = ItemsByExactClass.Find(ItemClass.Get()))
+	{
+		if (ClassItems->Num())
+		{
+			return (*ClassItems)[0]->GetQuantity() >= Quantity;
+		}
+	}
+
+	//Instances can be checked without needing a stand in for them
+	if (const FItemInstance* Instance = ItemInstances.Instances.FindByPredicate([&ItemClass](const FItemInstance& Instance) { return Instance.ItemClass == ItemClass; }))
 	{
-		return ItemToFind->GetQuantity() >= Quantity;
+		return Instance->Quantity >= Quantity;
 	}
+
 	return false;
 }
 
-UItem* UInventoryComponent::FindItem(UItem* Item) const
+UItem* UInventoryComponent::FindItem(UItem* Item)
 {
 	if (Item)
 	{
-		for (auto& InvItem : Items)
+		return FindItemByClass(Item->GetClass());
+	}
+	return nullptr;
+}
+
+UItem* UInventoryComponent::FindItemByClass(TSubclassOf<class UItem> ItemClass)
+{
+	if (UItem* InvItem = FindRealItemByClass(ItemClass))
+	{
+		return InvItem;
+	}
+
+	if (FItemInstance* Instance = ItemInstances.Instances.FindByPredicate([&ItemClass](const FItemInstance& Instance) { return Instance.ItemClass == ItemClass; }))
+	{
+		return GetInstanceProxy(*Instance);
+	}
+
+	return nullptr;
+}
+
+UItem* UInventoryComponent::FindRealItemByClass(TSubclassOf<class UItem> ItemClass) const
+{
+	if (const auto* ClassItems = ItemsByExactClass.Find(ItemClass.Get()))
+	{
+		if (ClassItems->Num())
+		{
+			return (*ClassItems)[0];
+		}
+	}
+	return nullptr;
+}
+
+TArray<UItem*> UInventoryComponent::FindItemsByClass(TSubclassOf<class UItem> ItemClass)
+{
+	TArray<UItem*> ClassItems;
+
+	if (const auto* ClassBucket = ItemsByClass.Find(ItemClass.Get()))
+	{
+		ClassItems.Append(*ClassBucket);
+	}
+
+	for (FItemInstance& Instance : ItemInstances.Instances)
+	{
+		if (Instance.ItemClass && Instance.ItemClass->IsChildOf(ItemClass))
 		{
-			if (InvItem && InvItem->GetClass() == Item->GetClass())
+			if (UItem* Proxy = GetInstanceProxy(Instance))
 			{
-				return InvItem;
+				ClassItems.Add(Proxy);
 			}
 		}
 	}
-	return nullptr;
+
+	return ClassItems;
 }
 
-UItem* UInventoryComponent::FindItemByClass(TSubclassOf<class UItem> ItemClass) const
+TArray<UItem*> UInventoryComponent::GetItems()
 {
-	for (auto& InvItem : Items)
+	TArray<UItem*> InventoryItems;
+	InventoryItems.Reserve(Items.Entries.Num() + ItemInstances.Instances.Num());
+
+	for (auto& Entry : Items.Entries)
+	{
+		if (Entry.Item)
+		{
+			InventoryItems.Add(Entry.Item);
+		}
+	}
+
+	for (auto& Instance : ItemInstances.Instances)
 	{
-		if (InvItem && InvItem->GetClass() == ItemClass)
+		if (UItem* Proxy = GetInstanceProxy(Instance))
 		{
-			return InvItem;
+			InventoryItems.Add(Proxy);
 		}
 	}
+
+	return InventoryItems;
+}
+
+UItem* UInventoryComponent::MaterializeInstance(const int32 InstanceID)
+{
+	if (GetOwner() && GetOwner()->HasAuthority())
+	{
+		const int32 InstanceIndex = ItemInstances.Instances.IndexOfByPredicate([InstanceID](const FItemInstance& Instance) { return Instance.ReplicationID == InstanceID; });
+
+		if (InstanceIndex != INDEX_NONE)
+		{
+			const FItemInstance Instance = ItemInstances.Instances[InstanceIndex];
+
+			ItemInstances.Instances.RemoveAt(InstanceIndex);
+			ItemInstances.MarkArrayDirty();
+
+			InstanceWeight = FMath::Max(0.0, InstanceWeight - Instance.GetStackWeight());
+			--NumInstances;
+
+			if (Instance.Proxy)
+			{
+				Instance.Proxy->InstanceInventory = nullptr;
+			}
+
+			if (Instance.ItemClass && Instance.Quantity > 0)
+			{
+				return AddItem(Instance.ItemClass->GetDefaultObject<UItem>(), Instance.Quantity);
+			}
+		}
+	}
+
 	return nullptr;
 }
 
-TArray<UItem*> UInventoryComponent::FindItemsByClass(TSubclassOf<class UItem> ItemClass) const
+void UInventoryComponent::RefreshInstanceTotals()
 {
-	TArray<UItem*> ItemsOfClass;
+	InstanceWeight = 0.0;
+	NumInstances = 0;
 
-	for (auto& InvItem : Items)
+	for (const FItemInstance& Instance : ItemInstances.Instances)
 	{
-		if (InvItem && InvItem->GetClass()->IsChildOf(ItemClass))
+		if (Instance.ItemClass)
 		{
-			ItemsOfClass.Add(InvItem);
+			InstanceWeight += Instance.GetStackWeight();
+			++NumInstances;
 		}
 	}
-
-	return ItemsOfClass;
 }
 
-float UInventoryComponent::GetCurrentWeight() const
+UItem* UInventoryComponent::GetInstanceProxy(FItemInstance& Instance)
 {
-	float Weight = 0.f;
+	if (!Instance.Proxy && Instance.ItemClass)
+	{
+		//Stand ins have no owning inventory, so nothing done to them can touch the totals
+		Instance.Proxy = NewObject<UItem>(GetOwner(), Instance.ItemClass, NAME_None, RF_Transient);
+		Instance.Proxy->World = GetWorld();
+		Instance.Proxy->Quantity = Instance.Quantity;
+		Instance.Proxy->InstanceInventory = this;
+		Instance.Proxy->InstanceID = Instance.ReplicationID;
+	}
 
-	for (auto& Item : Items)
+	return Instance.Proxy;
+}
+
+FItemAddResult UInventoryComponent::TryAddInstance_Internal(const UItem* ItemCDO, const int32 Quantity)
+{
+	if (GetOwner() && GetOwner()->HasAuthority())
 	{
-		if (Item)
+		int32 ActualAddAmount = Quantity;
+
+		FItemInstance* ExistingInstance = nullptr;
+
+		if (ItemCDO->bStackable)
 		{
-			Weight += Item->GetStackWeight();
+			ExistingInstance = ItemInstances.Instances.FindByPredicate([ItemCDO](const FItemInstance& Instance) 
+			{ 
+				return Instance.ItemClass == ItemCDO->GetClass() && Instance.Quantity < ItemCDO->MaxStackSize; 
+			});
 		}
+
+		if (ExistingInstance)
+		{
+			ActualAddAmount = FMath::Min(ActualAddAmount, ItemCDO->MaxStackSize - ExistingInstance->Quantity);
+		}
+		else if (GetNumItems() + 1 > GetCapacity())
+		{
+			return FItemAddResult::AddedNone(Quantity, FText::Format(LOCTEXT("InventoryCapacityFullText", "Couldn't add {ItemName} to Inventory. Inventory is full."), ItemCDO->DisplayName));
+		}
+
+		//Remember whether the stack or the weight is what stopped us, so the error says the right thing
+		bool bLimitedByWeight = false;
+
+		//Items with a weight of zero dont require a weight check
+		if (!FMath::IsNearlyZero(ItemCDO->Weight))
+		{
+			const int32 WeightMaxAddAmount = FMath::FloorToInt((WeightCapacity - GetCurrentWeight()) / ItemCDO->Weight);
+
+			if (WeightMaxAddAmount < ActualAddAmount)
+			{
+				ActualAddAmount = WeightMaxAddAmount;
+				bLimitedByWeight = true;
+			}
+		}
+
+		if (ActualAddAmount <= 0)
+		{
+			return FItemAddResult::AddedNone(Quantity, bLimitedByWeight 
+				? FText::Format(LOCTEXT("StackWeightFullText", "Couldn't add {ItemName}, too much weight."), ItemCDO->DisplayName)
+				: FText::Format(LOCTEXT("InstanceAddNoneText", "Couldn't add any {ItemName} to Inventory."), ItemCDO->DisplayName));
+		}
+
+		if (ExistingInstance)
+		{
+			ExistingInstance->Quantity += ActualAddAmount;
+			ExistingInstance->SyncProxy();
+			ItemInstances.MarkItemDirty(*ExistingInstance);
+		}
+		else
+		{
+			ItemInstances.MarkItemDirty(ItemInstances.Instances.Add_GetRef(FItemInstance(ItemCDO->GetClass(), ActualAddAmount)));
+			++NumInstances;
+		}
+
+		InstanceWeight += (double)ActualAddAmount * ItemCDO->Weight;
+
+		if (ActualAddAmount < Quantity)
+		{
+			return FItemAddResult::AddedSome(Quantity, ActualAddAmount, bLimitedByWeight 
+				? FText::Format(LOCTEXT("InventoryTooMuchWeightText", "Couldn't add entire stack of {ItemName} to Inventory."), ItemCDO->DisplayName)
+				: FText::Format(LOCTEXT("InstanceStackFullText", "Couldn't add entire stack of {ItemName}, the stack is full."), ItemCDO->DisplayName));
+		}
+
+		return FItemAddResult::AddedAll(Quantity);
 	}
 
-	return Weight;
+	return FItemAddResult::AddedNone(-1, LOCTEXT("ErrorMessage", ""));
 }
 
 void UInventoryComponent::SetWeightCapacity(const float NewWeightCapacity)
@@ -162,9 +632,32 @@ void UInventoryComponent::SetCapacity(const int32 NewCapacity)
 }
 
 
-void UInventoryComponent::ClientRefreshInventory_Implementation()
+void UInventoryComponent::MarkItemChanged(UItem* Item)
 {
-	OnInventoryUpdated.Broadcast();
+	ChangedItems.AddUnique(Item);
+
+	if (!TimerHandle_FlushChangedItems.IsValid())
+	{
+		if (UWorld* World = GetWorld())
+		{
+			TimerHandle_FlushChangedItems = World->GetTimerManager().SetTimerForNextTick(this, &UInventoryComponent::FlushChangedItems);
+		}
+	}
+}
+
+void UInventoryComponent::FlushChangedItems()
+{
+	TimerHandle_FlushChangedItems.Invalidate();
+
+	//Items can leave the inventory between being changed and the flush
+	TArray<UItem*> FlushedItems = MoveTemp(ChangedItems);
+	FlushedItems.RemoveAll([this](const UItem* Item) { return !IsValid(Item) || Item->OwningInventory != this; });
+
+	if (FlushedItems.Num())
+	{
+		OnInventoryItemsChanged.Broadcast(FlushedItems);
+		OnInventoryUpdated.Broadcast();
+	}
 }
 
 
@@ -174,68 +667,381 @@ void UInventoryComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>&
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
 	DOREPLIFETIME(UInventoryComponent, Items);
+	DOREPLIFETIME(UInventoryComponent, ItemInstances);
+	DOREPLIFETIME(UInventoryComponent, PublicNumItems);
+}
+
+void UInventoryComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	//Take everyone back out of our net group, so the group can't outlive us
+	for (const TWeakObjectPtr<APlayerController>& Member : LooterNetGroupMembers)
+	{
+		if (Member.IsValid())
+		{
+			Member->RemoveFromNetConditionGroup(LooterNetGroup);
+		}
+	}
+
+	LooterNetGroupMembers.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UInventoryComponent::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	PublicNumItems = GetNumItems();
+}
+
+bool UInventoryComponent::ShouldReplicateItemsTo(const UNetConnection* Connection) const
+{
+	AActor* Owner = GetOwner();
+
+	if (!Connection || !Owner)
+	{
+		return false;
+	}
+
+	if (Owner->GetNetConnection() == Connection)
+	{
+		return true;
+	}
+
+	//Anyone whose loot source is this inventory
+	if (Connection->PlayerController)
+	{
+		if (const ASurvivalCharacter* Looter = Cast<ASurvivalCharacter>(Connection->PlayerController->GetPawn()))
+		{
+			return Looter->GetLootSource() == this;
+		}
+	}
+
+	return false;
+}
+
+void UInventoryComponent::AddLooter(ASurvivalCharacter* Looter)
+{
+	Looters.AddUnique(Looter);
+	RefreshItemReplicationCondition();
 }
 
-bool UInventoryComponent::ReplicateSubobjects(UActorChannel* Channel, FOutBunch* Bunch, FReplicationFlags* RepFlags)
+void UInventoryComponent::RemoveLooter(ASurvivalCharacter* Looter)
 {
-	bool bWroteSomething = Super::ReplicateSubobjects(Channel, Bunch, RepFlags);
+	Looters.Remove(Looter);
+	RefreshItemReplicationCondition();
+}
+
+void UInventoryComponent::RefreshItemReplicationCondition()
+{
+	//Looters that died or left without letting go of us don't count
+	Looters.RemoveAll([this](const TWeakObjectPtr<ASurvivalCharacter>& Looter) { return !Looter.IsValid() || Looter->GetLootSource() != this; });
+
+	//Everyone who should get our items while we're being looted: the looters, and our owner so it doesn't lose them
+	TArray<APlayerController*, TInlineAllocator<4>> NewGroupMembers;
+
+	for (const TWeakObjectPtr<ASurvivalCharacter>& Looter : Looters)
+	{
+		if (APlayerController* LooterPC = Looter->GetController<APlayerController>())
+		{
+			NewGroupMembers.AddUnique(LooterPC);
+		}
+	}
+
+	if (NewGroupMembers.Num())
+	{
+		const UNetConnection* OwnerConnection = GetOwner() ? GetOwner()->GetNetConnection() : nullptr;
+
+		if (OwnerConnection && OwnerConnection->PlayerController)
+		{
+			NewGroupMembers.AddUnique(OwnerConnection->PlayerController);
+		}
+	}
 
-	//Check if the array of items needs to replicate
-	if (Channel->KeyNeedsToReplicate(0, ReplicatedItemsKey))
+	for (const TWeakObjectPtr<APlayerController>& Member : LooterNetGroupMembers)
 	{
-		for (auto& Item : Items)
+		if (Member.IsValid() && !NewGroupMembers.Contains(Member.Get()))
 		{
-			if (Channel->KeyNeedsToReplicate(Item->GetUniqueID(), Item->RepKey))
+			Member->RemoveFromNetConditionGroup(LooterNetGroup);
+		}
+	}
+
+	LooterNetGroupMembers.Reset();
+
+	for (APlayerController* Member : NewGroupMembers)
+	{
+		if (!Member->IsMemberOfNetConditionGroup(LooterNetGroup))
+		{
+			Member->IncludeInNetConditionGroup(LooterNetGroup);
+		}
+
+		LooterNetGroupMembers.Add(Member);
+	}
+
+	const ELifetimeCondition NewCondition = NewGroupMembers.Num() ? COND_NetGroup : COND_OwnerOnly;
+
+	if (NewCondition != ItemReplicationCondition)
+	{
+		ItemReplicationCondition = NewCondition;
+
+		//There's no way to change the condition of a registered subobject, so register them again
+		for (auto& Entry : Items.Entries)
+		{
+			if (Entry.Item)
 			{
-				bWroteSomething |= Channel->ReplicateSubobject(Item, *Bunch, *RepFlags);
+				RemoveReplicatedSubObject(Entry.Item);
+				AddReplicatedSubObject(Entry.Item, ItemReplicationCondition);
 			}
 		}
 	}
 
-	return bWroteSomething;
+	AActor* Owner = GetOwner();
+
+	if (Owner && Owner->HasAuthority())
+	{
+		if (Looters.Num() && Owner->NetDormancy > DORM_Awake)
+		{
+			OwnerDormancyBeforeLooting = Owner->NetDormancy;
+			Owner->SetNetDormancy(DORM_Awake);
+		}
+		else if (!Looters.Num() && OwnerDormancyBeforeLooting > DORM_Awake)
+		{
+			//Initial dormancy can't be gone back to once an actor has replicated, so settle for dormant to everyone
+			Owner->SetNetDormancy(OwnerDormancyBeforeLooting == DORM_Initial ? DORM_DormantAll : OwnerDormancyBeforeLooting.GetValue());
+			OwnerDormancyBeforeLooting = DORM_Never;
+		}
+	}
+}
+
+bool UInventoryComponent::RemoveEntry(UItem* Item)
+{
+	const int32 EntryIndex = Items.Entries.IndexOfByPredicate([Item](const FInventoryItemEntry& Entry) { return Entry.Item == Item; });
+
+	if (EntryIndex != INDEX_NONE)
+	{
+		Items.Entries.RemoveAt(EntryIndex);
+		Items.MarkArrayDirty();
+		RemoveReplicatedSubObject(Item);
+		UE::Net::FNetConditionGroupManager::UnregisterSubObjectFromGroup(Item, LooterNetGroup);
+
+		UntrackItem(Item);
+		Item->OwningInventory = nullptr;
+		return true;
+	}
+
+	return false;
 }
 
-UItem* UInventoryComponent::AddItem(UItem* Item)
+UItem* UInventoryComponent::AddItem(const UItem* Item, const int32 Quantity, UItem* ItemToMove)
 {
 	if (GetOwner() && GetOwner()->HasAuthority()) 
 	{
-		UItem* NewItem = NewObject<UItem>(GetOwner(), Item->GetClass());
+		UItem* NewItem = nullptr;
+
+		if (ItemToMove)
+		{
+			//Stop the source from still thinking it owns the item before we take it
+			if (UEquippableItem* EquippableItem = Cast<UEquippableItem>(ItemToMove))
+			{
+				if (EquippableItem->IsEquipped())
+				{
+					EquippableItem->SetEquipped(false);
+				}
+			}
+
+			if (ItemToMove->OwningInventory)
+			{
+				ItemToMove->OwningInventory->RemoveItem(ItemToMove);
+			}
+
+			AdoptItem(ItemToMove);
+			NewItem = ItemToMove;
+		}
+		else
+		{
+			NewItem = NewObject<UItem>(GetOwner(), Item->GetClass());
+		}
+
 		NewItem->World = GetWorld();
-		NewItem->SetQuantity(Item->GetQuantity());
+		NewItem->SetQuantity(Quantity);
 		NewItem->OwningInventory = this;
 		NewItem->AddedToInventory(this);
-		Items.Add(NewItem);
+		Items.MarkItemDirty(Items.Entries.Add_GetRef(FInventoryItemEntry(NewItem)));
+		UE::Net::FNetConditionGroupManager::RegisterSubObjectInGroup(NewItem, LooterNetGroup);
+		AddReplicatedSubObject(NewItem, ItemReplicationCondition);
 		NewItem->MarkDirtyForReplication();
 
+		TrackItem(NewItem);
+
 		return NewItem;
 	}
 
 	return nullptr;
 }
 
-void UInventoryComponent::OnRep_Items()
+void UInventoryComponent::AdoptItem(UItem* Item)
 {
-	OnInventoryUpdated.Broadcast();
+	AActor* OldOwner = Item->GetTypedOuter<AActor>();
+
+	if (OldOwner == GetOwner())
+	{
+		return;
+	}
+
+	/**Clients get a moved item through our channel under the same NetGUID, so it resolves to the copy that was created for the 
+	actor it came from. That actors channel would destroy the item along with the actor, so take it off the channels list.
+	If the old actor is already gone, the item simply arrives as a brand new object and we never get here.*/
+	if (OldOwner && !GetOwner()->HasAuthority())
+	{
+		UNetDriver* NetDriver = GetWorld() ? GetWorld()->GetNetDriver() : nullptr;
+
+		if (NetDriver && NetDriver->ServerConnection)
+		{
+			if (UActorChannel* OldChannel = NetDriver->ServerConnection->FindActorChannelRef(OldOwner))
+			{
+				OldChannel->CreateSubObjects.Remove(Item);
+			}
+		}
+	}
+
+	//Anything bound to the item belonged to its old owner, ie the pickup refreshing its interaction widget
+	Item->OnItemModified.Clear();
+	Item->Rename(*MakeUniqueObjectName(GetOwner(), Item->GetClass()).ToString(), GetOwner(), REN_DontCreateRedirectors | REN_DoNotDirty | REN_NonTransactional);
+}
+
+void UInventoryComponent::OnEntryAdded(UItem* Item)
+{
+	if (Item->GetOuter() != GetOwner())
+	{
+		AdoptItem(Item);
+	}
+
+	//A moved item can arrive here before the inventory it came from hears it was removed
+	if (Item->OwningInventory && Item->OwningInventory != this)
+	{
+		Item->OwningInventory->UntrackItem(Item);
+	}
+
+	Item->World = GetWorld();
+	Item->OwningInventory = this;
+	TrackItem(Item);
+	OnItemAdded.Broadcast(Item);
+}
+
+void UInventoryComponent::OnEntryRemoved(UItem* Item)
+{
+	//Items whose subobject never arrived were never counted
+	if (Item->World && Item->OwningInventory == this)
+	{
+		UntrackItem(Item);
+		Item->OwningInventory = nullptr;
+	}
+
+	OnItemRemoved.Broadcast(Item);
+}
+
+void UInventoryComponent::TrackItem(UItem* Item)
+{
+	CurrentWeight += Item->GetStackWeight();
+	++NumItems;
+
+	ItemsByExactClass.FindOrAdd(Item->GetClass()).Add(Item);
+
+	for (const UClass* Class = Item->GetClass(); Class && Class->IsChildOf(UItem::StaticClass()); Class = Class->GetSuperClass())
+	{
+		ItemsByClass.FindOrAdd(Class).Add(Item);
+	}
+
+#if !UE_BUILD_SHIPPING
+	CheckTotals();
+#endif
+}
+
+void UInventoryComponent::UntrackItem(UItem* Item)
+{
+	CurrentWeight = FMath::Max(0.0, CurrentWeight - Item->GetStackWeight());
+	--NumItems;
+
+	//Keep the buckets around even when empty, an inventory only ever sees a handful of classes
+	if (auto* ExactClassItems = ItemsByExactClass.Find(Item->GetClass()))
+	{
+		ExactClassItems->RemoveSingle(Item);
+	}
+
+	for (const UClass* Class = Item->GetClass(); Class && Class->IsChildOf(UItem::StaticClass()); Class = Class->GetSuperClass())
+	{
+		if (auto* ClassItems = ItemsByClass.Find(Class))
+		{
+			ClassItems->RemoveSingle(Item);
+		}
+	}
+
+	//We shouldn't ever remove more items than we added
+	ensure(NumItems >= 0);
+
+#if !UE_BUILD_SHIPPING
+	CheckTotals();
+#endif
+}
+
+void UInventoryComponent::OnItemQuantityChanged(UItem* Item, const int32 OldQuantity)
+{
+	CurrentWeight = FMath::Max(0.0, CurrentWeight + (double)(Item->GetQuantity() - OldQuantity) * Item->Weight);
+
+	MarkItemChanged(Item);
+
+#if !UE_BUILD_SHIPPING
+	CheckTotals();
+#endif
+}
+
+#if !UE_BUILD_SHIPPING
+void UInventoryComponent::CheckTotals() const
+{
+	if (CVarCheckInventoryTotals.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
 
-	for (auto& Item : Items)
+	double Weight = 0.0;
+	int32 Count = 0;
+
+	for (auto& Entry : Items.Entries)
 	{
-		if (!Item->World)
+		//On clients, only items that OnEntryAdded has seen are counted
+		if (Entry.Item && Entry.Item->OwningInventory == this && Entry.Item->World)
 		{
-			OnItemAdded.Broadcast(Item);
-			Item->World = GetWorld();
+			Weight += Entry.Item->GetStackWeight();
+			++Count;
 		}
 	}
+
+	ensureMsgf(FMath::IsNearlyEqual(Weight, CurrentWeight, 0.01) && Count == NumItems, TEXT("%s inventory totals out of sync. Running weight %f, actual %f. Running count %d, actual %d"),
+		*GetPathName(), CurrentWeight, Weight, NumItems, Count);
+
+	const auto* AllItems = ItemsByClass.Find(UItem::StaticClass());
+	ensureMsgf((AllItems ? AllItems->Num() : 0) == Count, TEXT("%s inventory class lookup out of sync."), *GetPathName());
+
+	int32 ExactCount = 0;
+
+	for (const auto& ClassItems : ItemsByExactClass)
+	{
+		ExactCount += ClassItems.Value.Num();
+	}
+
+	ensureMsgf(ExactCount == Count, TEXT("%s inventory exact class lookup out of sync."), *GetPathName());
 }
+#endif
 
-FItemAddResult UInventoryComponent::TryAddItem_Internal(UItem* Item)
+FItemAddResult UInventoryComponent::TryAddItem_Internal(const UItem* Item, const int32 Quantity, UItem** OutAddedTo, UItem* ItemToMove)
 {
 	if (GetOwner() && GetOwner()->HasAuthority())
 	{
-		const int32 AddAmount = Item->GetQuantity();
+		const int32 AddAmount = Quantity;
 
-		if (Items.Num() + 1 > GetCapacity())
+		if (GetNumItems() + 1 > GetCapacity())
 		{
-			return FItemAddResult::AddedNone(Item->GetQuantity(), FText::Format(LOCTEXT("InventoryCapacityFullText", "Couldn't add {ItemName} to Inventory. Inventory is full."), Item->DisplayName));
+			return FItemAddResult::AddedNone(AddAmount, FText::Format(LOCTEXT("InventoryCapacityFullText", "Couldn't add {ItemName} to Inventory. Inventory is full."), Item->DisplayName));
 		}
 
 		//Items with a weight of zero dont require a weight check
@@ -243,16 +1049,16 @@ FItemAddResult UInventoryComponent::TryAddItem_Internal(UItem* Item)
 		{
 			if (GetCurrentWeight() + Item->Weight > GetWeightCapacity())
 			{
-				return FItemAddResult::AddedNone(Item->GetQuantity(), FText::Format(LOCTEXT("StackWeightFullText", "Couldn't add {ItemName}, too much weight."), Item->DisplayName));
+				return FItemAddResult::AddedNone(AddAmount, FText::Format(LOCTEXT("StackWeightFullText", "Couldn't add {ItemName}, too much weight."), Item->DisplayName));
 			}
 		}
 
 		if (Item->bStackable)
 		{
 			//Somehow the items quantity went over the max stack size. This shouldn't ever happen
-			ensure(Item->GetQuantity() <= Item->MaxStackSize);
+			ensure(AddAmount <= Item->MaxStackSize);
 
-			if (UItem* ExistingItem = FindItem(Item))
+			if (UItem* ExistingItem = FindRealItemByClass(Item->GetClass()))
 			{
 				if (ExistingItem->GetQuantity() < ExistingItem->MaxStackSize)
 				{
@@ -288,6 +1094,11 @@ FItemAddResult UInventoryComponent::TryAddItem_Internal(UItem* Item)
 
 					ExistingItem->SetQuantity(ExistingItem->GetQuantity() + ActualAddAmount);
 
+					if (OutAddedTo)
+					{
+						*OutAddedTo = ExistingItem;
+					}
+
 					//If we somehow get more of the item than the max stack  size then something is wrong with our math
 					ensure(ExistingItem->GetQuantity() <= ExistingItem->MaxStackSize);
 
@@ -308,7 +1119,12 @@ FItemAddResult UInventoryComponent::TryAddItem_Internal(UItem* Item)
 			else
 			{
 				//Since we dont have any of this item, we'll add the full stack
-				AddItem(Item);
+				UItem* NewItem = AddItem(Item, AddAmount, ItemToMove);
+
+				if (OutAddedTo)
+				{
+					*OutAddedTo = NewItem;
+				}
 
 				return FItemAddResult::AddedAll(AddAmount);
 			}
@@ -317,9 +1133,14 @@ FItemAddResult UInventoryComponent::TryAddItem_Internal(UItem* Item)
 		{
 			//Non-stackable should always have a quantity of 1
 
-			ensure(Item->GetQuantity() == 1);
+			ensure(AddAmount == 1);
+
+			UItem* NewItem = AddItem(Item, AddAmount, ItemToMove);
 
-			AddItem(Item);
+			if (OutAddedTo)
+			{
+				*OutAddedTo = NewItem;
+			}
 
 			return FItemAddResult::AddedAll(AddAmount);
 		}
@@ -330,4 +1151,102 @@ FItemAddResult UInventoryComponent::TryAddItem_Internal(UItem* Item)
 	return FItemAddResult::AddedNone(-1, LOCTEXT("ErrorMessage", ""));
 }
 
+#if !UE_BUILD_SHIPPING
+/**Compare the class lookup against walking the items, for inventories of 20, 200 and 2000 items.
+Usage: Survival.Inventory.BenchmarkLookups [Iterations]*/
+static void BenchmarkInventoryLookups(const TArray<FString>& Args, UWorld* World)
+{
+	if (!World)
+	{
+		return;
+	}
+
+	const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 10000;
+	const TArray<TSubclassOf<UItem>> FillerClasses = { UWeaponItem::StaticClass(), UGearItem::StaticClass(), UThrowableItem::StaticClass() };
+	const int32 InventorySizes[] = { 20, 200, 2000 };
+
+	for (const int32 InventorySize : InventorySizes)
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.ObjectFlags |= RF_Transient;
+
+		AActor* Owner = World->SpawnActor<AActor>(SpawnParams);
+		if (!Owner || !Owner->HasAuthority())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Inventory benchmark needs to run on the server or in standalone."));
+			return;
+		}
+
+		UInventoryComponent* Inventory = NewObject<UInventoryComponent>(Owner);
+		Inventory->SetCapacity(InventorySize);
+		Inventory->SetWeightCapacity(TNumericLimits<float>::Max());
+
+		//Equippables don't stack so each one gets its own slot. The ammo we look for goes in last, the worst case for a walk.
+		for (int32 i = 0; i < InventorySize - 1; ++i)
+		{
+			Inventory->TryAddItemFromClass(FillerClasses[i % FillerClasses.Num()], 1);
+		}
+		Inventory->TryAddItemFromClass(UAmmoItem::StaticClass(), 1);
+
+		const TArray<UItem*> AllItems = Inventory->GetItems();
+		int32 Found = 0;
+
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; ++i)
+		{
+			for (UItem* Item : AllItems)
+			{
+				if (Item->GetClass() == UAmmoItem::StaticClass())
+				{
+					++Found;
+					break;
+				}
+			}
+		}
+		const double ScanFindTime = FPlatformTime::Seconds() - StartTime;
+
+		StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; ++i)
+		{
+			Found += Inventory->FindItemByClass(UAmmoItem::StaticClass()) != nullptr;
+		}
+		const double IndexFindTime = FPlatformTime::Seconds() - StartTime;
+
+		StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; ++i)
+		{
+			TArray<UItem*> Weapons;
+			for (UItem* Item : AllItems)
+			{
+				if (Item->GetClass()->IsChildOf(UWeaponItem::StaticClass()))
+				{
+					Weapons.Add(Item);
+				}
+			}
+			Found += Weapons.Num();
+		}
+		const double ScanFindAllTime = FPlatformTime::Seconds() - StartTime;
+
+		StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; ++i)
+		{
+			Found += Inventory->FindItemsByClass(UWeaponItem::StaticClass()).Num();
+		}
+		const double IndexFindAllTime = FPlatformTime::Seconds() - StartTime;
+
+		UE_LOG(LogTemp, Display, TEXT("Inventory lookups, %d items, %d iterations: FindItemByClass scan %.3fus index %.3fus | FindItemsByClass scan %.3fus index %.3fus (%d)"),
+			InventorySize, Iterations, 
+			ScanFindTime * 1e6 / Iterations, IndexFindTime * 1e6 / Iterations,
+			ScanFindAllTime * 1e6 / Iterations, IndexFindAllTime * 1e6 / Iterations, Found);
+
+		Owner->Destroy();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkInventoryLookupsCmd(
+	TEXT("Survival.Inventory.BenchmarkLookups"),
+	TEXT("Time FindItemByClass/FindItemsByClass against walking the items, at 20, 200 and 2000 items. Usage: Survival.Inventory.BenchmarkLookups [Iterations]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkInventoryLookups));
+#endif
+
 #undef LOCTEXT_NAMESPACE
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "SurvivalGame/Items/Item.h"
 #include "Components/ActorComponent.h"
+#include "Net/Serialization/FastArraySerializer.h"
 #include "InventoryComponent.generated.h"
 
 //Called when the inventory is changed and the UI needs an update. 
@@ -14,6 +15,9 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnInventoryUpdated);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnItemAdded, class UItem*, Item);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnItemRemoved, class UItem*, Item);
 
+//Called at most once a frame with every item that was changed, ie had its quantity modified
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnInventoryItemsChanged, const TArray<class UItem*>&, ChangedItems);
+
 UENUM(BlueprintType)
 enum class EItemAddResult : uint8
 {
@@ -82,12 +86,136 @@ public:
 
 };
 
+//A single entry in a batched add, see UInventoryComponent::TryAddItems
+USTRUCT(BlueprintType)
+struct FItemAddRequest
+{
+	GENERATED_BODY()
+
+public:
+
+	FItemAddRequest() {};
+	FItemAddRequest(TSubclassOf<class UItem> InItemClass, const int32 InQuantity) : ItemClass(InItemClass), Quantity(InQuantity) {};
+
+	//The type of item to add
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Item Add Request")
+	TSubclassOf<class UItem> ItemClass;
+
+	//How many of the item to add
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Item Add Request")
+	int32 Quantity = 1;
+};
+
+/**A single slot in the inventory. Only slots that were added, changed or removed get sent to clients.*/
+USTRUCT()
+struct FInventoryItemEntry : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	FInventoryItemEntry() {};
+	FInventoryItemEntry(class UItem* InItem) : Item(InItem) {};
+
+	UPROPERTY()
+	class UItem* Item = nullptr;
+
+	//Client side callbacks, called by the fast array serializer
+	void PreReplicatedRemove(const struct FInventoryItemList& InArraySerializer);
+	void PostReplicatedAdd(const struct FInventoryItemList& InArraySerializer);
+	void PostReplicatedChange(const struct FInventoryItemList& InArraySerializer);
+};
+
+/**The items in an inventory. Delta replicated, so changing one item doesn't resend the whole array.*/
+USTRUCT()
+struct FInventoryItemList : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FInventoryItemEntry> Entries;
+
+	//The inventory that owns this list. Set in the inventory constructor, never replicated.
+	class UInventoryComponent* OwnerComponent = nullptr;
+
+	void PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters);
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+};
+
+/**A lightweight stand in for a UItem: just the item class and how many of it. Inventories with bUseItemInstances store items added 
+by class like this, so a chest full of loot doesn't cost a UObject per stack. Quantity is the only state items change at runtime, 
+so it's all we keep.*/
+USTRUCT()
+struct FItemInstance : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	FItemInstance() {};
+	FItemInstance(TSubclassOf<class UItem> InItemClass, const int32 InQuantity) : ItemClass(InItemClass), Quantity(InQuantity) {};
+
+	UPROPERTY()
+	TSubclassOf<class UItem> ItemClass;
+
+	UPROPERTY()
+	int32 Quantity = 0;
+
+	//Local item created the first time something needs a UItem for this instance, ie the loot menu. Never replicated.
+	UPROPERTY(NotReplicated)
+	class UItem* Proxy = nullptr;
+
+	float GetStackWeight() const;
+
+	//Push the quantity to the proxy, if we have one
+	void SyncProxy();
+
+	//Client side callbacks, called by the fast array serializer
+	void PreReplicatedRemove(const struct FItemInstanceList& InArraySerializer);
+	void PostReplicatedChange(const struct FItemInstanceList& InArraySerializer);
+};
+
+USTRUCT()
+struct FItemInstanceList : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FItemInstance> Instances;
+
+	//The inventory that owns this list. Set in the inventory constructor, never replicated.
+	class UInventoryComponent* OwnerComponent = nullptr;
+
+	void PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters);
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+};
+
+template<>
+struct TStructOpsTypeTraits<FItemInstanceList> : public TStructOpsTypeTraitsBase2<FItemInstanceList>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
+template<>
+struct TStructOpsTypeTraits<FInventoryItemList> : public TStructOpsTypeTraitsBase2<FInventoryItemList>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class SURVIVALGAME_API UInventoryComponent : public UActorComponent
 {
 	GENERATED_BODY()
 
 		friend class UItem;
+		friend struct FInventoryItemEntry;
+		friend struct FInventoryItemList;
+		friend struct FItemInstance;
+		friend struct FItemInstanceList;
 
 public:	
 	// Sets default values for this component's properties
@@ -105,6 +233,19 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	FItemAddResult TryAddItemFromClass(TSubclassOf<class UItem> ItemClass, const int32 Quantity = 1);
 
+	/**[Server] Move an item into this inventory from a pickup or another inventory. If the whole item goes into a new slot the item 
+	itself is moved over instead of copied, so nothing is left behind for the garbage collector. Otherwise it gets stacked onto 
+	what we already have, and whatever doesn't fit stays where it was.
+	@return the amount of the item that was added to the inventory */
+	FItemAddResult TryMoveItem(class UItem* Item);
+
+	/**Add a list of items to the inventory in one go. Replication and OnInventoryUpdated only fire once for the whole batch, 
+	which makes it the way to fill chests, corpses or loot everything at once.
+	@param bAllOrNothing if true and any item can't be fully added, nothing is added and every result is AddedNone.
+	@return the result of each request, in the same order as Requests */
+	UFUNCTION(BlueprintCallable, Category = "Inventory")
+	TArray<FItemAddResult> TryAddItems(const TArray<FItemAddRequest>& Requests, const bool bAllOrNothing = false);
+
 	/** Take some quantity away from the item, and remove it from the inventory when quantity reaches zero.
 	Useful for things like eating food, using ammo, etc.*/
 	int32 ConsumeItem(class UItem* Item);
@@ -114,25 +255,50 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	bool RemoveItem(class UItem* Item);
 
-	/**Return true if we have a given amount of an item*/
+	/**Return true if we have a given amount of an item, either as an item or an item instance*/
 	UFUNCTION(BlueprintPure, Category = "Inventory")
 	bool HasItem(TSubclassOf <class UItem> ItemClass, const int32 Quantity = 1) const;
 
 	/**Return the first item with the same class as a given Item*/
 	UFUNCTION(BlueprintPure, Category = "Inventory")
-	UItem* FindItem(class UItem* Item) const;
+	UItem* FindItem(class UItem* Item);
 
-	/**Return the first item with the same class as ItemClass.*/
+	/**Return the first item with the same class as ItemClass. Item instances are looked at too, and returned as their stand in*/
 	UFUNCTION(BlueprintPure, Category = "Inventory")
-	UItem* FindItemByClass(TSubclassOf<class UItem> ItemClass) const;
+	UItem* FindItemByClass(TSubclassOf<class UItem> ItemClass);
 
-	/**Get all inventory items that are a child of ItemClass. Useful for grabbing all weapons, all food, etc*/
+	/**Get all inventory items that are a child of ItemClass, with item instances as their stand ins. Useful for grabbing all weapons, all food, etc*/
 	UFUNCTION(BlueprintPure, Category = "Inventory")
-	TArray<UItem*> FindItemsByClass(TSubclassOf<class UItem> ItemClass) const;
+	TArray<UItem*> FindItemsByClass(TSubclassOf<class UItem> ItemClass);
 
-	//Get the current weight of the inventory. To get the amount of items in the inventory, just do GetItems().Num()
+	//Get the current weight of the inventory. This is a running total, so it's cheap to call as often as needed
 	UFUNCTION(BlueprintPure, Category = "Inventory")
-	float GetCurrentWeight() const;
+	FORCEINLINE float GetCurrentWeight() const { return (float)(CurrentWeight + InstanceWeight); }
+
+	//Get the amount of item stacks in the inventory, including item instances. Like the weight, this is kept as a running total
+	UFUNCTION(BlueprintPure, Category = "Inventory")
+	FORCEINLINE int32 GetNumItems() const { return NumItems + NumInstances; }
+
+	/**The number of item stacks, as sent to every client. Clients that aren't the owner or looting us don't get the items themselves, 
+	so use this instead of GetNumItems() for things like showing whether a chest is empty*/
+	UFUNCTION(BlueprintPure, Category = "Inventory")
+	FORCEINLINE int32 GetPublicNumItems() const { return PublicNumItems; }
+
+	/**[Server] Whether a connection gets sent the items in this inventory. Only the owner and players looting us do*/
+	bool ShouldReplicateItemsTo(const class UNetConnection* Connection) const;
+
+	//[Server] Called by players as they start and stop looting this inventory
+	void AddLooter(class ASurvivalCharacter* Looter);
+	void RemoveLooter(class ASurvivalCharacter* Looter);
+
+	//Only call this before anything has been added to the inventory
+	FORCEINLINE void SetUseItemInstances(const bool bNewUseItemInstances) { bUseItemInstances = bNewUseItemInstances; }
+
+	FORCEINLINE const TArray<FItemInstance>& GetItemInstances() const { return ItemInstances.Instances; }
+
+	/**[Server] Turn an item instance into a real item in this inventory, ie because a player is taking it.
+	@return the new item, or nullptr if there is no instance with that id */
+	UItem* MaterializeInstance(const int32 InstanceID);
 
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	void SetWeightCapacity(const float NewWeightCapacity);
@@ -146,11 +312,10 @@ public:
 	UFUNCTION(BlueprintPure, Category = "Inventory")
 	FORCEINLINE int32 GetCapacity() const { return Capacity; }
 
+	/**Get the items in the inventory. Item instances are returned as stand in items, which are created the first time they're asked for.
+	Stand ins can be shown, looted and consumed like any other item, but changing them directly does nothing*/
 	UFUNCTION(BlueprintPure, Category = "Inventory")
-	FORCEINLINE TArray<class UItem*> GetItems() const { return Items; }
-
-	UFUNCTION(Client, Reliable)
-	void ClientRefreshInventory();
+	TArray<class UItem*> GetItems();
 
 	UPROPERTY(BlueprintAssignable, Category = "Inventory")
 	FOnInventoryUpdated OnInventoryUpdated;
@@ -161,6 +326,11 @@ public:
 	UPROPERTY(BlueprintAssignable, Category = "Inventory")
 	FOnItemRemoved OnItemRemoved;
 
+	/**Lists the items that changed since the last time this was called, so the UI can update just those. 
+	OnInventoryUpdated is called straight after for anything that still wants to rebuild everything.*/
+	UPROPERTY(BlueprintAssignable, Category = "Inventory")
+	FOnInventoryItemsChanged OnInventoryItemsChanged;
+
 protected:
 
 	//The maximum weight the inventory can hold. For players, backpacks and other items increase this limit
@@ -172,24 +342,111 @@ protected:
 	int32 Capacity;
 
 	/**The items currently in our inventory*/
-	UPROPERTY(ReplicatedUsing = OnRep_Items, VisibleAnywhere, Category = "Inventory")
-	TArray<class UItem*> Items;
+	UPROPERTY(Replicated, VisibleAnywhere, Category = "Inventory")
+	FInventoryItemList Items;
+
+	/**If true, items added by class (TryAddItemFromClass, TryAddItems) are stored as item instances instead of UItems, and only become
+	real items when someone takes them. Meant for containers like chests that mostly sit there unopened.*/
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Inventory")
+	bool bUseItemInstances;
+
+	UPROPERTY(Replicated, VisibleAnywhere, Category = "Inventory")
+	FItemInstanceList ItemInstances;
+
+	UPROPERTY(Replicated)
+	int32 PublicNumItems;
 
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
-	virtual bool ReplicateSubobjects(class UActorChannel* Channel, class FOutBunch* Bunch, FReplicationFlags* RepFlags) override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 private:
 
-	/**Don't call Items.Add() directly, use this function instead, as it handles replication and ownership*/
-	UItem* AddItem(class UItem* Item);
+	/**Don't call Items.Add() directly, use this function instead, as it handles replication and ownership.
+	Item is only used as a template, so it can be a class default object. 
+	@param ItemToMove if set, this item is taken from wherever it is and added, instead of creating a new one*/
+	UItem* AddItem(const class UItem* Item, const int32 Quantity, class UItem* ItemToMove = nullptr);
 
-	UFUNCTION()
-	void OnRep_Items();
+	//Take an item away from its current inventory or pickup and make this inventories owner its outer
+	void AdoptItem(class UItem* Item);
 
-	UPROPERTY()
-	int32 ReplicatedItemsKey;
+	//Take an item out of the items array, without notifying anyone. Returns false if the item wasn't in this inventory
+	bool RemoveEntry(class UItem* Item);
+
+	//[client] Called by the item list when an item arrives or is about to be removed
+	void OnEntryAdded(class UItem* Item);
+	void OnEntryRemoved(class UItem* Item);
+
+	/**Players looting this inventory. While anyone is looting us, our items switch from COND_OwnerOnly to COND_NetGroup, and 
+	the looters' and owner's controllers are put in LooterNetGroup, so only they get sent the items.*/
+	TArray<TWeakObjectPtr<class ASurvivalCharacter>> Looters;
+
+	ELifetimeCondition ItemReplicationCondition;
+
+	//Net condition group of the players that can see our items while we're being looted. Every item is registered in it
+	FName LooterNetGroup;
+
+	//The controllers we put in LooterNetGroup, so we can take them back out even if their pawn is gone
+	TArray<TWeakObjectPtr<class APlayerController>> LooterNetGroupMembers;
+
+	/**Dormant owners (chests) are woken while anyone is looting them, so taking items shows up straight away. This is what they 
+	were before, so they can go back to sleep once the last looter leaves. DORM_Never if we didn't wake the owner.*/
+	TEnumAsByte<ENetDormancy> OwnerDormancyBeforeLooting;
+
+	void RefreshItemReplicationCondition();
+
+	/**Running totals of the items in the inventory. Kept up to date by AddItem, RemoveItem and UItem::SetQuantity 
+	so the weight and slot checks don't have to walk every item. Double precision so adding and removing weights doesn't drift.*/
+	double CurrentWeight;
+	int32 NumItems;
+
+	/**Every item in the inventory, listed under its own class and each of its parent classes up to UItem. 
+	Lets FindItemsByClass (ie all weapons) skip walking every item. 
+	The Items array keeps the items alive, so this doesn't need to be a UPROPERTY*/
+	TMap<const UClass*, TArray<class UItem*, TInlineAllocator<2>>> ItemsByClass;
+
+	//Every item in the inventory, listed under its own class only, so FindItemByClass doesn't have to look through child classes
+	TMap<const UClass*, TArray<class UItem*, TInlineAllocator<1>>> ItemsByExactClass;
+
+	//Weight and count of the item instances, on top of CurrentWeight and NumItems
+	double InstanceWeight;
+	int32 NumInstances;
+
+	//[client] Instances only replicate their quantity, so recount them whenever the list changes
+	void RefreshInstanceTotals();
+
+	//Add to the item instances instead of the items. Same rules as TryAddItem_Internal, except a full stack starts a new one
+	FItemAddResult TryAddInstance_Internal(const class UItem* ItemCDO, const int32 Quantity);
+
+	UItem* GetInstanceProxy(FItemInstance& Instance);
+
+	//FindItemByClass without the item instances, for stacking onto items we already have
+	UItem* FindRealItemByClass(TSubclassOf<class UItem> ItemClass) const;
+
+	//Update the running totals and class lookup when an item enters or leaves the inventory, or when its quantity changes
+	void TrackItem(class UItem* Item);
+	void UntrackItem(class UItem* Item);
+	void OnItemQuantityChanged(class UItem* Item, const int32 OldQuantity);
+
+	/**Items changed since the last flush. Changes are collected rather than sent one by one, because things like reloading 
+	or firing change the same few items many times in a row. The quantities themselves replicate with the items, 
+	so both the server and clients collect their own changes and nothing extra is sent.*/
+	UPROPERTY(Transient)
+	TArray<class UItem*> ChangedItems;
+
+	FTimerHandle TimerHandle_FlushChangedItems;
+
+	void MarkItemChanged(class UItem* Item);
+	void FlushChangedItems();
+
+#if !UE_BUILD_SHIPPING
+	//Debug only - recalculate the totals and lookup from scratch and make sure they match the running ones
+	void CheckTotals() const;
+#endif
 
-	//Internal, non-BP exposed add item function. Don't call this directly, use TryAddItem(), or TryAddItemFromClass() instead.
-	FItemAddResult TryAddItem_Internal(class UItem* Item);
+	/**Internal, non-BP exposed add item function. Don't call this directly, use TryAddItem(), TryAddItemFromClass() or TryAddItems() instead.
+	Item is only used as a template, so it can be a class default object. 
+	@param OutAddedTo if set, receives the item the quantity ended up in - either a new item or an existing stack*/
+	FItemAddResult TryAddItem_Internal(const class UItem* Item, const int32 Quantity, class UItem** OutAddedTo = nullptr, class UItem* ItemToMove = nullptr);
 
 };
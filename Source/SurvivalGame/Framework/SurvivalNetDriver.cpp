@@ -0,0 +1,236 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurvivalGame/Framework/SurvivalNetDriver.h"
+#include "Engine/NetConnection.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/DateTime.h"
+#include "SurvivalGame/Weapons/Weapon.h"
+#include "SurvivalGame/Components/InteractionComponent.h"
+#include "SurvivalGame/Components/InventoryComponent.h"
+#include "SurvivalGame/Items/Item.h"
+
+DEFINE_STAT(STAT_SurvivalNet_RPCsSent);
+DEFINE_STAT(STAT_SurvivalNet_RPCBytesSent);
+DEFINE_STAT(STAT_SurvivalNet_RPCsReceived);
+DEFINE_STAT(STAT_SurvivalNet_WeaponFireBytes);
+DEFINE_STAT(STAT_SurvivalNet_InventoryBytes);
+DEFINE_STAT(STAT_SurvivalNet_InteractionBytes);
+
+static TAutoConsoleVariable<int32> CVarSurvivalNetStats(
+	TEXT("Survival.Net.Stats"),
+	0,
+	TEXT("If non zero, the net driver measures every RPC it sends and counts every RPC it receives, per connection. See stat SurvivalNet and Survival.Net.DumpStats."),
+	ECVF_Default);
+
+TMap<FString, TMap<FName, FSurvivalNetRPCStat>> FSurvivalNetStats::Stats;
+double FSurvivalNetStats::StartTime = 0.0;
+
+bool FSurvivalNetStats::IsEnabled()
+{
+	return CVarSurvivalNetStats.GetValueOnGameThread() != 0;
+}
+
+ESurvivalNetCategory FSurvivalNetStats::GetCategory(const UFunction* Function)
+{
+	const UClass* OwnerClass = Function->GetOwnerClass();
+	const FString FunctionName = Function->GetName();
+
+	if (OwnerClass->IsChildOf(AWeapon::StaticClass()) || FunctionName.Contains(TEXT("Melee")) || FunctionName.Contains(TEXT("Throwable")))
+	{
+		return ESurvivalNetCategory::WeaponFire;
+	}
+
+	if (OwnerClass->IsChildOf(UInteractionComponent::StaticClass()) || FunctionName.Contains(TEXT("Interact")))
+	{
+		return ESurvivalNetCategory::Interaction;
+	}
+
+	if (OwnerClass->IsChildOf(UInventoryComponent::StaticClass()) || OwnerClass->IsChildOf(UItem::StaticClass()) || FunctionName.Contains(TEXT("Item")) || FunctionName.Contains(TEXT("Loot")))
+	{
+		return ESurvivalNetCategory::Inventory;
+	}
+
+	return ESurvivalNetCategory::Other;
+}
+
+FSurvivalNetRPCStat& FSurvivalNetStats::FindOrAddStat(const UNetConnection* Connection, const UFunction* Function)
+{
+	if (StartTime == 0.0)
+	{
+		StartTime = FPlatformTime::Seconds();
+	}
+
+	const FString ConnectionName = Connection ? Connection->LowLevelGetRemoteAddress(true) : TEXT("None");
+	TMap<FName, FSurvivalNetRPCStat>& ConnectionStats = Stats.FindOrAdd(ConnectionName);
+
+	FSurvivalNetRPCStat* Stat = ConnectionStats.Find(Function->GetFName());
+
+	if (!Stat)
+	{
+		Stat = &ConnectionStats.Add(Function->GetFName());
+		Stat->Category = GetCategory(Function);
+	}
+
+	return *Stat;
+}
+
+void FSurvivalNetStats::RecordSentRPC(const UNetConnection* Connection, const UFunction* Function, const int64 Bits)
+{
+	const int64 Bytes = (Bits + 7) / 8;
+
+	FSurvivalNetRPCStat& Stat = FindOrAddStat(Connection, Function);
+	++Stat.SentCount;
+	Stat.SentBytes += Bytes;
+
+	INC_DWORD_STAT(STAT_SurvivalNet_RPCsSent);
+	INC_DWORD_STAT_BY(STAT_SurvivalNet_RPCBytesSent, Bytes);
+
+	switch (Stat.Category)
+	{
+	case ESurvivalNetCategory::WeaponFire:
+		INC_DWORD_STAT_BY(STAT_SurvivalNet_WeaponFireBytes, Bytes);
+		break;
+	case ESurvivalNetCategory::Inventory:
+		INC_DWORD_STAT_BY(STAT_SurvivalNet_InventoryBytes, Bytes);
+		break;
+	case ESurvivalNetCategory::Interaction:
+		INC_DWORD_STAT_BY(STAT_SurvivalNet_InteractionBytes, Bytes);
+		break;
+	default:
+		break;
+	}
+}
+
+void FSurvivalNetStats::RecordReceivedRPC(const UNetConnection* Connection, const UFunction* Function)
+{
+	++FindOrAddStat(Connection, Function).ReceivedCount;
+
+	INC_DWORD_STAT(STAT_SurvivalNet_RPCsReceived);
+}
+
+void FSurvivalNetStats::Reset()
+{
+	Stats.Reset();
+	StartTime = 0.0;
+}
+
+FString FSurvivalNetStats::DumpToCSV(const FString& FileName)
+{
+	static const TCHAR* CategoryNames[] = { TEXT("WeaponFire"), TEXT("Inventory"), TEXT("Interaction"), TEXT("Other") };
+
+	const double Duration = StartTime > 0.0 ? FMath::Max(FPlatformTime::Seconds() - StartTime, 1.0) : 1.0;
+
+	FString CSV = TEXT("Connection,RPC,Category,SentCount,SentBytes,SentBytesPerSecond,ReceivedCount\n");
+
+	for (const auto& ConnectionStats : Stats)
+	{
+		for (const auto& RPCStat : ConnectionStats.Value)
+		{
+			CSV += FString::Printf(TEXT("%s,%s,%s,%lld,%lld,%.1f,%lld\n"), *ConnectionStats.Key, *RPCStat.Key.ToString(), CategoryNames[(uint8)RPCStat.Value.Category],
+				RPCStat.Value.SentCount, RPCStat.Value.SentBytes, RPCStat.Value.SentBytes / Duration, RPCStat.Value.ReceivedCount);
+		}
+	}
+
+	const FString FilePath = FPaths::Combine(FPaths::ProfilingDir(), TEXT("SurvivalNet"), FileName.IsEmpty() ? FString::Printf(TEXT("NetStats-%s.csv"), *FDateTime::Now().ToString()) : FileName);
+
+	return FFileHelper::SaveStringToFile(CSV, *FilePath) ? FilePath : FString();
+}
+
+static FAutoConsoleCommand DumpNetStatsCmd(
+	TEXT("Survival.Net.DumpStats"),
+	TEXT("Write the RPC stats recorded while Survival.Net.Stats was on to Saved/Profiling/SurvivalNet as CSV. Usage: Survival.Net.DumpStats [FileName]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const FString FilePath = FSurvivalNetStats::DumpToCSV(Args.Num() ? Args[0] : FString());
+
+		if (FilePath.IsEmpty())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Couldn't write net stats."));
+		}
+		else
+		{
+			UE_LOG(LogTemp, Display, TEXT("Wrote net stats to %s"), *FilePath);
+		}
+	}));
+
+static FAutoConsoleCommand ResetNetStatsCmd(
+	TEXT("Survival.Net.ResetStats"),
+	TEXT("Clear the RPC stats recorded so far."),
+	FConsoleCommandDelegate::CreateStatic(&FSurvivalNetStats::Reset));
+
+//How much has been written to a connection so far. Packets that get flushed mid RPC count towards OutBytes instead of the send buffer
+static int64 GetBitsWritten(const UNetConnection* Connection)
+{
+	return (int64)Connection->OutBytes * 8 + Connection->SendBuffer.GetNumBits();
+}
+
+void USurvivalNetDriver::ProcessRemoteFunction(AActor* Actor, UFunction* Function, void* Parameters, FOutParmRec* OutParms, FFrame* Stack, UObject* SubObject)
+{
+	if (!FSurvivalNetStats::IsEnabled() || !Actor || !Function)
+	{
+		Super::ProcessRemoteFunction(Actor, Function, Parameters, OutParms, Stack, SubObject);
+		return;
+	}
+
+	//Work out which connections this RPC could be written to, so we can see how much each one grew by
+	TArray<UNetConnection*, TInlineAllocator<8>> Connections;
+
+	if (ServerConnection)
+	{
+		Connections.Add(ServerConnection);
+	}
+	else if (Function->FunctionFlags & FUNC_NetMulticast)
+	{
+		Connections.Append(ClientConnections);
+	}
+	else if (UNetConnection* OwnerConnection = Actor->GetNetConnection())
+	{
+		Connections.Add(OwnerConnection);
+	}
+
+	TArray<int64, TInlineAllocator<8>> BitsBefore;
+	BitsBefore.Reserve(Connections.Num());
+
+	for (UNetConnection* Connection : Connections)
+	{
+		BitsBefore.Add(GetBitsWritten(Connection));
+	}
+
+	Super::ProcessRemoteFunction(Actor, Function, Parameters, OutParms, Stack, SubObject);
+
+	for (int32 i = 0; i < Connections.Num(); ++i)
+	{
+		//Skip connections it wasn't relevant to
+		const int64 Bits = GetBitsWritten(Connections[i]) - BitsBefore[i];
+
+		if (Bits > 0)
+		{
+			FSurvivalNetStats::RecordSentRPC(Connections[i], Function, Bits);
+		}
+	}
+}
+
+bool USurvivalNetDriver::ShouldCallRemoteFunction(UObject* Object, UFunction* Function, const FReplicationFlags& RepFlags) const
+{
+	const bool bShouldCall = Super::ShouldCallRemoteFunction(Object, Function, RepFlags);
+
+	/**We don't get told how big incoming RPCs were, only that they arrived. Server RPCs can only come from the owning
+	connection, so that's who sent it*/
+	if (bShouldCall && Object && Function && FSurvivalNetStats::IsEnabled())
+	{
+		const AActor* Actor = Cast<AActor>(Object);
+
+		if (!Actor)
+		{
+			Actor = Object->GetTypedOuter<AActor>();
+		}
+
+		FSurvivalNetStats::RecordReceivedRPC(ServerConnection ? ServerConnection : (Actor ? Actor->GetNetConnection() : nullptr), Function);
+	}
+
+	return bShouldCall;
+}
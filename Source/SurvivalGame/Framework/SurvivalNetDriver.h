@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "IpNetDriver.h"
+#include "Stats/Stats.h"
+#include "SurvivalNetDriver.generated.h"
+
+DECLARE_STATS_GROUP(TEXT("SurvivalNet"), STATGROUP_SurvivalNet, STATCAT_Advanced);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("RPCs Sent"), STAT_SurvivalNet_RPCsSent, STATGROUP_SurvivalNet, SURVIVALGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("RPC Bytes Sent"), STAT_SurvivalNet_RPCBytesSent, STATGROUP_SurvivalNet, SURVIVALGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("RPCs Received"), STAT_SurvivalNet_RPCsReceived, STATGROUP_SurvivalNet, SURVIVALGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Weapon Fire RPC Bytes"), STAT_SurvivalNet_WeaponFireBytes, STATGROUP_SurvivalNet, SURVIVALGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Inventory RPC Bytes"), STAT_SurvivalNet_InventoryBytes, STATGROUP_SurvivalNet, SURVIVALGAME_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Interaction RPC Bytes"), STAT_SurvivalNet_InteractionBytes, STATGROUP_SurvivalNet, SURVIVALGAME_API);
+
+//What area of the game an RPC belongs to, so the worst offenders can be grouped together
+enum class ESurvivalNetCategory : uint8
+{
+	WeaponFire,
+	Inventory,
+	Interaction,
+	Other
+};
+
+//Totals for one RPC on one connection
+struct FSurvivalNetRPCStat
+{
+	int64 SentCount = 0;
+	int64 SentBytes = 0;
+	int64 ReceivedCount = 0;
+	ESurvivalNetCategory Category = ESurvivalNetCategory::Other;
+};
+
+/**
+ * Keeps per connection, per RPC counts and sizes while Survival.Net.Stats is on. Dump them with Survival.Net.DumpStats, which
+ * works on dedicated servers too. Replicated properties are tracked per actor class by the replication graph's CSV tracker,
+ * so run csvprofile alongside this to get both.
+ */
+class SURVIVALGAME_API FSurvivalNetStats
+{
+public:
+
+	static bool IsEnabled();
+
+	static ESurvivalNetCategory GetCategory(const UFunction* Function);
+
+	static void RecordSentRPC(const class UNetConnection* Connection, const UFunction* Function, const int64 Bits);
+	static void RecordReceivedRPC(const class UNetConnection* Connection, const UFunction* Function);
+
+	static void Reset();
+
+	//Write everything recorded since the last reset out as CSV. Returns the path written to, or empty if it couldn't be saved
+	static FString DumpToCSV(const FString& FileName);
+
+private:
+
+	static FSurvivalNetRPCStat& FindOrAddStat(const class UNetConnection* Connection, const UFunction* Function);
+
+	//Connection address -> RPC name -> totals
+	static TMap<FString, TMap<FName, FSurvivalNetRPCStat>> Stats;
+
+	static double StartTime;
+};
+
+/**
+ * Game net driver. Same as the ip net driver, but measures the RPCs that go through it so we can see what our bandwidth goes on.
+ */
+UCLASS(Transient, Config = Engine)
+class SURVIVALGAME_API USurvivalNetDriver : public UIpNetDriver
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void ProcessRemoteFunction(class AActor* Actor, class UFunction* Function, void* Parameters, struct FOutParmRec* OutParms, struct FFrame* Stack, class UObject* SubObject = nullptr) override;
+	virtual bool ShouldCallRemoteFunction(UObject* Object, UFunction* Function, const FReplicationFlags& RepFlags) const override;
+
+};
@@ -0,0 +1,245 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurvivalGame/Framework/SurvivalReplicationGraph.h"
+#include "ReplicationGraphTypes.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetConnection.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/Pawn.h"
+#include "UObject/UObjectIterator.h"
+#include "SurvivalGame/Player/SurvivalCharacter.h"
+#include "SurvivalGame/Components/InventoryComponent.h"
+#include "SurvivalGame/Weapons/Weapon.h"
+#include "SurvivalGame/World/Pickup.h"
+#include "SurvivalGame/World/LootableChest.h"
+#include "SurvivalGame/World/LootField.h"
+
+USurvivalReplicationGraph::USurvivalReplicationGraph()
+{
+	GridCellSize = 10000.f;
+	GridSpatialBias = FVector2D(-200000.f, -200000.f);
+	GridNode = nullptr;
+	AlwaysRelevantNode = nullptr;
+}
+
+void USurvivalReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	//Pickups and chests only change when they're taken from, so they're dormant most of the time
+	ClassRepNodePolicies.Set(APickup::StaticClass(), ESurvivalRepNodeMapping::Spatialize_Dormancy);
+	ClassRepNodePolicies.Set(ALootableChest::StaticClass(), ESurvivalRepNodeMapping::Spatialize_Dormancy);
+	ClassRepNodePolicies.Set(ASurvivalCharacter::StaticClass(), ESurvivalRepNodeMapping::Spatialize_Dynamic);
+
+	//Loot fields cover the whole map and only send the records that changed, so everyone gets them
+	ClassRepNodePolicies.Set(ALootField::StaticClass(), ESurvivalRepNodeMapping::RelevantAllConnections);
+
+	//Weapons are only ever held, so they go wherever their character goes
+	ClassRepNodePolicies.Set(AWeapon::StaticClass(), ESurvivalRepNodeMapping::NotRouted);
+
+#if CSV_PROFILER
+	//Break replication time and bits out per class in csvprofile captures, so we can see what each kind of actor costs
+	CSVTracker.SetImplicitClassTracking(ASurvivalCharacter::StaticClass(), FName(TEXT("Character")));
+	CSVTracker.SetImplicitClassTracking(AWeapon::StaticClass(), FName(TEXT("Weapon")));
+	CSVTracker.SetImplicitClassTracking(APickup::StaticClass(), FName(TEXT("Pickup")));
+	CSVTracker.SetImplicitClassTracking(ALootableChest::StaticClass(), FName(TEXT("LootableChest")));
+	CSVTracker.SetImplicitClassTracking(ALootField::StaticClass(), FName(TEXT("LootField")));
+#endif
+
+	//Work out a policy and the update rate for every replicated actor class up front, rather than on the first spawn of each
+	for (TObjectIterator<UClass> It; It; ++It)
+	{
+		UClass* Class = *It;
+		AActor* ActorCDO = Cast<AActor>(Class->GetDefaultObject());
+
+		if (!ActorCDO || !ActorCDO->GetIsReplicated() || Class->HasAnyClassFlags(CLASS_Abstract | CLASS_Deprecated | CLASS_NewerVersionExists))
+		{
+			continue;
+		}
+
+		//Skeleton and reinstanced blueprint classes aren't real
+		if (Class->GetName().StartsWith(TEXT("SKEL_")) || Class->GetName().StartsWith(TEXT("REINST_")))
+		{
+			continue;
+		}
+
+		const ESurvivalRepNodeMapping Policy = GetMappingPolicy(Class);
+		const bool bSpatialize = Policy != ESurvivalRepNodeMapping::NotRouted && Policy != ESurvivalRepNodeMapping::RelevantAllConnections;
+
+		FClassReplicationInfo ClassInfo;
+		InitClassReplicationInfo(ClassInfo, Class, bSpatialize);
+		GlobalActorReplicationInfoMap.SetClassInfo(Class, ClassInfo);
+	}
+}
+
+void USurvivalReplicationGraph::InitGlobalGraphNodes()
+{
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = GridCellSize;
+	GridNode->SpatialBias = GridSpatialBias;
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+}
+
+void USurvivalReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection)
+{
+	Super::InitConnectionGraphNodes(RepGraphConnection);
+
+	USurvivalReplicationGraphNode_AlwaysRelevant_ForConnection* AlwaysRelevantConnectionNode = CreateNewNode<USurvivalReplicationGraphNode_AlwaysRelevant_ForConnection>();
+	AddConnectionGraphNode(AlwaysRelevantConnectionNode, RepGraphConnection);
+}
+
+void USurvivalReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	switch (GetMappingPolicy(ActorInfo.Class))
+	{
+	case ESurvivalRepNodeMapping::NotRouted:
+	{
+		//Weapons are spawned with their character as the owner, and get destroyed rather than handed to anyone else
+		if (AWeapon* Weapon = Cast<AWeapon>(ActorInfo.Actor))
+		{
+			if (AActor* WeaponOwner = Weapon->GetOwner())
+			{
+				GlobalActorReplicationInfoMap.AddDependentActor(WeaponOwner, Weapon);
+			}
+		}
+		break;
+	}
+	case ESurvivalRepNodeMapping::RelevantAllConnections:
+	{
+		AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+		break;
+	}
+	case ESurvivalRepNodeMapping::Spatialize_Static:
+	{
+		GridNode->AddActor_Static(ActorInfo, GlobalInfo);
+		break;
+	}
+	case ESurvivalRepNodeMapping::Spatialize_Dynamic:
+	{
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+		break;
+	}
+	case ESurvivalRepNodeMapping::Spatialize_Dormancy:
+	{
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+		break;
+	}
+	}
+}
+
+void USurvivalReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	switch (GetMappingPolicy(ActorInfo.Class))
+	{
+	case ESurvivalRepNodeMapping::NotRouted:
+	{
+		if (AWeapon* Weapon = Cast<AWeapon>(ActorInfo.Actor))
+		{
+			if (AActor* WeaponOwner = Weapon->GetOwner())
+			{
+				GlobalActorReplicationInfoMap.RemoveDependentActor(WeaponOwner, Weapon);
+			}
+		}
+		break;
+	}
+	case ESurvivalRepNodeMapping::RelevantAllConnections:
+	{
+		AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+		break;
+	}
+	case ESurvivalRepNodeMapping::Spatialize_Static:
+	{
+		GridNode->RemoveActor_Static(ActorInfo);
+		break;
+	}
+	case ESurvivalRepNodeMapping::Spatialize_Dynamic:
+	{
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+		break;
+	}
+	case ESurvivalRepNodeMapping::Spatialize_Dormancy:
+	{
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+		break;
+	}
+	}
+}
+
+ESurvivalRepNodeMapping USurvivalReplicationGraph::GetMappingPolicy(UClass* Class)
+{
+	if (ESurvivalRepNodeMapping* Policy = ClassRepNodePolicies.Get(Class))
+	{
+		return *Policy;
+	}
+
+	//Nothing set for this class or its parents, so go off the relevancy flags the class already has
+	ESurvivalRepNodeMapping Policy = ESurvivalRepNodeMapping::Spatialize_Dynamic;
+	const AActor* ActorCDO = Cast<AActor>(Class->GetDefaultObject());
+
+	if (ActorCDO)
+	{
+		if (ActorCDO->bAlwaysRelevant)
+		{
+			Policy = ESurvivalRepNodeMapping::RelevantAllConnections;
+		}
+		else if (ActorCDO->bOnlyRelevantToOwner)
+		{
+			Policy = ESurvivalRepNodeMapping::NotRouted;
+		}
+		else if (ActorCDO->NetDormancy > DORM_Awake)
+		{
+			Policy = ESurvivalRepNodeMapping::Spatialize_Dormancy;
+		}
+	}
+
+	ClassRepNodePolicies.Set(Class, Policy);
+	return Policy;
+}
+
+void USurvivalReplicationGraph::InitClassReplicationInfo(FClassReplicationInfo& Info, UClass* Class, bool bSpatialize) const
+{
+	const AActor* ActorCDO = Cast<AActor>(Class->GetDefaultObject());
+
+	if (bSpatialize)
+	{
+		Info.SetCullDistanceSquared(ActorCDO->NetCullDistanceSquared);
+	}
+
+	//Turn the update frequency the class asks for into a number of replication frames between updates
+	const float ServerMaxTickRate = NetDriver ? NetDriver->GetNetServerMaxTickRate() : 30.f;
+	Info.ReplicationPeriodFrame = FMath::Max<uint32>((uint32)FMath::RoundToFloat(ServerMaxTickRate / FMath::Max(ActorCDO->NetUpdateFrequency, 1.f)), 1);
+}
+
+void USurvivalReplicationGraphNode_AlwaysRelevant_ForConnection::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	ReplicationActorList.Reset();
+
+	for (const FNetViewer& Viewer : Params.Viewers)
+	{
+		ReplicationActorList.ConditionalAdd(Viewer.InViewer);
+		ReplicationActorList.ConditionalAdd(Viewer.ViewTarget);
+
+		if (APlayerController* PC = Cast<APlayerController>(Viewer.InViewer))
+		{
+			APawn* Pawn = PC->GetPawn();
+
+			//The player's inventory is replicated on their pawn, so it can't fall out of the grid for them
+			ReplicationActorList.ConditionalAdd(Pawn);
+
+			//Keep sending whatever we're looting, even if it's a long way off in the grid, so the loot menu doesn't go stale
+			if (ASurvivalCharacter* Character = Cast<ASurvivalCharacter>(Pawn))
+			{
+				if (UInventoryComponent* LootSource = Character->GetLootSource())
+				{
+					ReplicationActorList.ConditionalAdd(LootSource->GetOwner());
+				}
+			}
+		}
+	}
+
+	Super::GatherActorListsForConnection(Params);
+}
@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "SurvivalReplicationGraph.generated.h"
+
+//How actors of a class get routed into the graph
+enum class ESurvivalRepNodeMapping : uint32
+{
+	NotRouted,				//Not routed to any node. Owner only actors go through the connection node, weapons ride along with their character
+	RelevantAllConnections,	//Sent to every connection, ie game state and player states
+	Spatialize_Static,		//Put in the grid once and never moved
+	Spatialize_Dynamic,		//Put in the grid and updated every frame
+	Spatialize_Dormancy,	//Put in the grid, treated as static while dormant and dynamic while awake. Pickups and chests
+};
+
+/**
+ * Replaces the default per actor relevancy checks. Pickups, chests and characters live in a spatial grid so each connection only
+ * considers what's in the cells around it, rather than the net driver checking every actor against every connection.
+ */
+UCLASS(Transient, Config = Engine)
+class SURVIVALGAME_API USurvivalReplicationGraph : public UReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+
+	USurvivalReplicationGraph();
+
+	virtual void InitGlobalActorClassSettings() override;
+	virtual void InitGlobalGraphNodes() override;
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection) override;
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+
+	//Size of a grid cell. Should be around the net cull distance of the things in the grid
+	UPROPERTY(Config)
+	float GridCellSize;
+
+	//Where the grid starts. Anything below this gets clamped into the first row or column of cells
+	UPROPERTY(Config)
+	FVector2D GridSpatialBias;
+
+	UPROPERTY()
+	class UReplicationGraphNode_GridSpatialization2D* GridNode;
+
+	UPROPERTY()
+	class UReplicationGraphNode_ActorList* AlwaysRelevantNode;
+
+protected:
+
+	ESurvivalRepNodeMapping GetMappingPolicy(UClass* Class);
+
+	void InitClassReplicationInfo(FClassReplicationInfo& Info, UClass* Class, bool bSpatialize) const;
+
+	TClassMap<ESurvivalRepNodeMapping> ClassRepNodePolicies;
+
+};
+
+/**
+ * Per connection node. Always sends a player their own controller, pawn and whatever they're looting, regardless of where the
+ * grid thinks they are. The player's inventory lives on their pawn so this keeps it flowing to them.
+ */
+UCLASS()
+class SURVIVALGAME_API USurvivalReplicationGraphNode_AlwaysRelevant_ForConnection : public UReplicationGraphNode_AlwaysRelevant_ForConnection
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+
+};
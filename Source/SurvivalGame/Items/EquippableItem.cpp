@@ -3,6 +3,7 @@
 
 #include "EquippableItem.h"
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
 #include "SurvivalGame/Player/SurvivalCharacter.h"
 #include "SurvivalGame/Components/InventoryComponent.h"
 
@@ -19,7 +20,10 @@ void UEquippableItem::GetLifetimeReplicatedProps(TArray<class FLifetimeProperty>
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME(UEquippableItem, bEquipped);
+	FDoRepLifetimeParams PushParams;
+	PushParams.bIsPushBased = true;
+
+	DOREPLIFETIME_WITH_PARAMS_FAST(UEquippableItem, bEquipped, PushParams);
 }
 
 void UEquippableItem::Use(class ASurvivalCharacter* Character)
@@ -79,6 +83,7 @@ void UEquippableItem::AddedToInventory(UInventoryComponent* Inventory)
 void UEquippableItem::SetEquipped(bool bNewEquipped)
 {
 	bEquipped = bNewEquipped;
+	MARK_PROPERTY_DIRTY_FROM_NAME(UEquippableItem, bEquipped, this);
 	EquipStatusChanged();
 	MarkDirtyForReplication();
 }
@@ -4,6 +4,8 @@
 #include "SurvivalGame/Items/Item.h"
 #include "SurvivalGame/Components/InventoryComponent.h"
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
+#include "GameFramework/Actor.h"
 
 #define LOCTEXT_NAMESPACE "Item"
 
@@ -11,7 +13,10 @@ void UItem::GetLifetimeReplicatedProps(TArray<class FLifetimeProperty>& OutLifet
 {
     Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-    DOREPLIFETIME(UItem, Quantity);
+    FDoRepLifetimeParams PushParams;
+    PushParams.bIsPushBased = true;
+
+    DOREPLIFETIME_WITH_PARAMS_FAST(UItem, Quantity, PushParams);
 }
 
 bool UItem::IsSupportedForNetworking() const
@@ -54,11 +59,18 @@ UItem::UItem()
 	bStackable = true;
 	Quantity = 1;
 	MaxStackSize = 2;
-	RepKey = 0;
+	InstanceInventory = nullptr;
+	InstanceID = INDEX_NONE;
 }
 
-void UItem::OnRep_Quantity()
+void UItem::OnRep_Quantity(int32 OldQuantity)
 {
+	//Only update the inventory totals once the inventory knows about this item 
+	if (OwningInventory && World)
+	{
+		OwningInventory->OnItemQuantityChanged(this, OldQuantity);
+	}
+
 	OnItemModified.Broadcast();
 }
 
@@ -66,8 +78,16 @@ void UItem::SetQuantity(const int32 NewQuantity)
 {
 	if (NewQuantity != Quantity)
 	{
+		const int32 OldQuantity = Quantity;
+
 		Quantity = FMath::Clamp(NewQuantity, 0, bStackable ? MaxStackSize : 1);
+		MARK_PROPERTY_DIRTY_FROM_NAME(UItem, Quantity, this);
 		MarkDirtyForReplication();
+
+		if (OwningInventory)
+		{
+			OwningInventory->OnItemQuantityChanged(this, OldQuantity);
+		}
 	}
 }
 
@@ -86,13 +106,10 @@ void UItem::AddedToInventory(UInventoryComponent* Inventory)
 
 void UItem::MarkDirtyForReplication()
 {
-	//Mark this object for replication
-	++RepKey;
-
-	//MArk the array for replication
-	if (OwningInventory)
+	//Pickups and chests sit dormant until something about them changes, so wake whoever holds us for a net update
+	if (AActor* OwnerActor = GetTypedOuter<AActor>())
 	{
-		++OwningInventory->ReplicatedItemsKey;
+		OwnerActor->FlushNetDormancy();
 	}
 }
 
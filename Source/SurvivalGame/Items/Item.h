@@ -91,15 +91,19 @@ public:
 	UPROPERTY()
 	class UInventoryComponent* OwningInventory;
 
-	/**Used to efficiently replicate inventory items*/
-	UPROPERTY()
-	int32 RepKey;
+	/**If this item is just a stand in for an item instance, the inventory holding the instance. See FItemInstance*/
+	UPROPERTY(Transient)
+	class UInventoryComponent* InstanceInventory;
+
+	/**The replication id of the item instance we stand in for*/
+	UPROPERTY(Transient)
+	int32 InstanceID;
 
 	UPROPERTY(BlueprintAssignable)
 	FOnItemModified OnItemModified;
 
 	UFUNCTION()
-	void OnRep_Quantity();
+	void OnRep_Quantity(int32 OldQuantity);
 
 	UFUNCTION(BlueprintCallable, Category = "Item")
 	void SetQuantity(const int32 NewQuantity);
@@ -3,6 +3,7 @@
 
 #include "SurvivalCharacter.h"
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
 #include "Camera/CameraComponent.h"
 #include "SurvivalGame/Player/SurvivalPlayerController.h"
 #include "Components/CapsuleComponent.h"
@@ -15,6 +16,7 @@
 #include "SurvivalGame/Items/ThrowableItem.h"
 #include "Materials/MaterialInstance.h"
 #include "SurvivalGame/World/Pickup.h"
+#include "SurvivalGame/World/InteractionSubsystem.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "GameFramework/PlayerState.h"
 #include "GameFramework/SpringArmComponent.h"
@@ -24,13 +26,18 @@
 #include "Kismet/GameplayStatics.h"
 #include "SurvivalGame/SurvivalGame.h"
 #include "SurvivalGame/Weapons/Weapon.h"
+#include "SurvivalGame/Weapons/LagCompensationSubsystem.h"
 #include "Runtime/Engine/Classes/Engine/World.h"
+#include "WorldCollision.h"
 
 
 #define LOCTEXT_NAMESPACE "SurvivalCharacter"
 
 static FName NAME_AimDownSightsSocket("ADSSocket");
 
+//Radius of the sphere melee attacks sweep with
+static const float MeleeSweepRadius = 15.f;
+
 // Sets default values
 ASurvivalCharacter::ASurvivalCharacter()
 {
@@ -76,7 +83,7 @@ ASurvivalCharacter::ASurvivalCharacter()
 	LootPlayerInteraction->SetActive(false, true);
 	LootPlayerInteraction->bAutoActivate = false;
 
-	InteractionCheckFrequency = 0.f;
+	InteractionCheckFrequency = 0.1f;
 	InteractionCheckDistance = 1000.f;
 
 	MaxHealth = 100.f;
@@ -93,6 +100,8 @@ ASurvivalCharacter::ASurvivalCharacter()
 	GetMesh()->SetOwnerNoSee(true);
 
 	GetCharacterMovement()->NavAgentProps.bCanCrouch = true;
+
+	bReplicateUsingRegisteredSubObjectList = true;
 }
 
 // Called when the game starts or when spawned
@@ -113,19 +122,45 @@ void ASurvivalCharacter::BeginPlay()
 	{
 		NakedMeshes.Add(PlayerMesh.Key, PlayerMesh.Value->SkeletalMesh);
 	}
+
+	//The server remembers where our hitboxes were so other players' hits on us can be checked
+	if (HasAuthority())
+	{
+		if (ULagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<ULagCompensationSubsystem>())
+		{
+			LagCompensation->RegisterCharacter(this);
+		}
+	}
+}
+
+void ASurvivalCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (ULagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<ULagCompensationSubsystem>())
+	{
+		LagCompensation->UnregisterCharacter(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void ASurvivalCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
-	DOREPLIFETIME(ASurvivalCharacter, bSprinting);
-	DOREPLIFETIME(ASurvivalCharacter, LootSource);
-	DOREPLIFETIME(ASurvivalCharacter, EquippedWeapon);
-	DOREPLIFETIME(ASurvivalCharacter, Killer);
+	//These only change at a few known places, which mark them dirty, so there's no need to compare them every update
+	FDoRepLifetimeParams PushParams;
+	PushParams.bIsPushBased = true;
 
-	DOREPLIFETIME_CONDITION(ASurvivalCharacter, Health, COND_OwnerOnly);
-	DOREPLIFETIME_CONDITION(ASurvivalCharacter, bIsAiming, COND_SkipOwner);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ASurvivalCharacter, bSprinting, PushParams);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ASurvivalCharacter, LootSource, PushParams);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ASurvivalCharacter, EquippedWeapon, PushParams);
+	DOREPLIFETIME_WITH_PARAMS_FAST(ASurvivalCharacter, Killer, PushParams);
+
+	PushParams.Condition = COND_OwnerOnly;
+	DOREPLIFETIME_WITH_PARAMS_FAST(ASurvivalCharacter, Health, PushParams);
+
+	PushParams.Condition = COND_SkipOwner;
+	DOREPLIFETIME_WITH_PARAMS_FAST(ASurvivalCharacter, bIsAiming, PushParams);
 }
 
 bool ASurvivalCharacter::IsInteracting() const
@@ -273,6 +308,7 @@ void ASurvivalCharacter::EquipWeapon(UWeaponItem* WeaponItem)
 			Weapon->Item = WeaponItem;
 
 			EquippedWeapon = Weapon;
+			MARK_PROPERTY_DIRTY_FROM_NAME(ASurvivalCharacter, EquippedWeapon, this);
 			OnRep_EquippedWeapon();
 
 			Weapon->OnEquip();
@@ -287,6 +323,7 @@ void ASurvivalCharacter::UnEquipWeapon()
 		EquippedWeapon->OnUnEquip();
 		EquippedWeapon->Destroy();
 		EquippedWeapon = nullptr;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ASurvivalCharacter, EquippedWeapon, this);
 		OnRep_EquippedWeapon();
 	}
 }
@@ -417,6 +454,7 @@ float ASurvivalCharacter::ModifyHealth(const float Delta)
 	const float OldHealth = Health;
 
 	Health = FMath::Clamp<float>(Health + Delta, 0.f, MaxHealth);
+	MARK_PROPERTY_DIRTY_FROM_NAME(ASurvivalCharacter, Health, this);
 
 	return Health - OldHealth;
 }
@@ -459,7 +497,7 @@ void ASurvivalCharacter::BeginMeleeAttack()
 	if (GetWorld()->TimeSince(LastMeleeAttackTime) > MeleeAttackMontage->GetPlayLength())
 	{
 		FHitResult Hit;
-		FCollisionShape Shape = FCollisionShape::MakeSphere(15.f);
+		FCollisionShape Shape = FCollisionShape::MakeSphere(MeleeSweepRadius);
 
 
 		FVector StartTrace = CameraComponent->GetComponentLocation();
@@ -502,20 +540,50 @@ void ASurvivalCharacter::ServerProcessMeleeHit_Implementation(const FHitResult&
 	{	
 		MulticastPlayMeleeFX();
 
-		UGameplayStatics::ApplyPointDamage(MeleeHit.GetActor(), MeleeAttackDamage, (MeleeHit.TraceStart - MeleeHit.TraceEnd).GetSafeNormal(), MeleeHit, GetController(), this, UMeleeDamage::StaticClass());
+		/**Melee hits don't carry a timestamp, but the attacker saw everyone roughly their ping ago, so check the hit against 
+		where the target was then. Hits are checked in a batch at the end of the frame*/
+		ASurvivalCharacter* HitPlayer = Cast<ASurvivalCharacter>(MeleeHit.GetActor());
+		ULagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<ULagCompensationSubsystem>();
+		const float Ping = GetPlayerState() ? GetPlayerState()->GetPingInMilliseconds() * 0.001f : 0.f;
+		const float HitTime = GetWorld()->GetTimeSeconds() - Ping;
+
+		//The swing has to start about where we were looking from, and can't reach further than a swing does
+		const bool bSwingValid = FVector::Dist(MeleeHit.TraceStart, MeleeHit.TraceEnd) <= MeleeAttackDistance + 1.f
+			&& (!LagCompensation || LagCompensation->IsShotOriginValid(this, HitTime, MeleeHit.TraceStart));
+
+		if (bSwingValid && HitPlayer && LagCompensation)
+		{
+			LagCompensation->QueueHit(this, HitPlayer, HitTime, MeleeHit.TraceStart, MeleeHit.TraceEnd, MeleeSweepRadius, MeleeHit.BoneName,
+				FOnLagCompensatedHitVerified::CreateUObject(this, &ASurvivalCharacter::ApplyMeleeHit, MeleeHit));
+		}
+		else if (bSwingValid)
+		{
+			ApplyMeleeHit(true, MeleeHit.BoneName, MeleeHit);
+		}
 	}
 	LastMeleeAttackTime = GetWorld()->GetTimeSeconds();
 }
 
+void ASurvivalCharacter::ApplyMeleeHit(const bool bValidHit, const FName BoneName, FHitResult MeleeHit)
+{
+	if (bValidHit && IsValid(MeleeHit.GetActor()))
+	{
+		MeleeHit.BoneName = BoneName;
+		UGameplayStatics::ApplyPointDamage(MeleeHit.GetActor(), MeleeAttackDamage, (MeleeHit.TraceStart - MeleeHit.TraceEnd).GetSafeNormal(), MeleeHit, GetController(), this, UMeleeDamage::StaticClass());
+	}
+}
+
 void ASurvivalCharacter::Suicide(FDamageEvent const& DamageEvent, const AActor* DamageCauser)
 {
 	Killer = this;
+	MARK_PROPERTY_DIRTY_FROM_NAME(ASurvivalCharacter, Killer, this);
 	OnRep_Killer();
 }
 
 void ASurvivalCharacter::KilledByPlayer(FDamageEvent const& DamageEvent, ASurvivalCharacter* Character, const AActor* DamageCauser)
 {
 	Killer = Character;
+	MARK_PROPERTY_DIRTY_FROM_NAME(ASurvivalCharacter, Killer, this);
 	OnRep_Killer();
 }
 
@@ -583,6 +651,7 @@ void ASurvivalCharacter::SetSprinting(const bool bNewSprinting)
 	}
 
 	bSprinting = bNewSprinting;
+	MARK_PROPERTY_DIRTY_FROM_NAME(ASurvivalCharacter, bSprinting, this);
 
 	GetCharacterMovement()->MaxWalkSpeed = bSprinting ? SprintSpeed : WalkSpeed;
 }
@@ -670,6 +739,7 @@ void ASurvivalCharacter::SetAiming(const bool bNewAiming)
 	}
 
 	bIsAiming = bNewAiming;
+	MARK_PROPERTY_DIRTY_FROM_NAME(ASurvivalCharacter, bIsAiming, this);
 }
 
 void ASurvivalCharacter::ServerSetAiming_Implementation(const bool bNewAiming)
@@ -682,11 +752,18 @@ void ASurvivalCharacter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	//const bool bIsInteractingOnServer = (HasAuthority() && IsInteracting());
-
+	/**Only the player doing the looking needs to know what they're looking at. The server checks once when they begin
+	interacting, and then keeps checking only while a non-instant interact is underway*/
 	if (GetWorld()->TimeSince(InteractionData.LastInteractionCheckTime) > InteractionCheckFrequency)
 	{
-		PerformInteractionCheck();
+		if (IsLocallyControlled())
+		{
+			PerformInteractionCheck();
+		}
+		else if (HasAuthority() && IsInteracting())
+		{
+			ServerCheckInteractable();
+		}
 	}
 
 	if (IsLocallyControlled())
@@ -757,7 +834,23 @@ void ASurvivalCharacter::SetLootSource(UInventoryComponent* NewLootSource)
 			}
 		}
 
+		UInventoryComponent* OldLootSource = LootSource;
 		LootSource = NewLootSource;
+		MARK_PROPERTY_DIRTY_FROM_NAME(ASurvivalCharacter, LootSource, this);
+
+		if (OldLootSource != NewLootSource)
+		{
+			if (OldLootSource)
+			{
+				OldLootSource->RemoveLooter(this);
+			}
+
+			if (NewLootSource)
+			{
+				NewLootSource->AddLooter(this);
+			}
+		}
+
 		OnRep_LootSource();
 	}
 	else
@@ -821,13 +914,24 @@ void ASurvivalCharacter::LootItem(UItem* ItemToGive)
 {
 	if (HasAuthority())
 	{
-		if (PlayerInventory && LootSource && ItemToGive && LootSource->HasItem(ItemToGive->GetClass(), ItemToGive->GetQuantity()))
+		//Item instances are only shown as stand in items, so swap the stand in for a real item before taking it
+		if (ItemToGive && ItemToGive->InstanceInventory)
+		{
+			ItemToGive = ItemToGive->InstanceInventory == LootSource ? LootSource->MaterializeInstance(ItemToGive->InstanceID) : nullptr;
+		}
+
+		//Make sure the item really is in what we're looting, clients can send us any item
+		if (PlayerInventory && LootSource && ItemToGive && ItemToGive->OwningInventory == LootSource)
 		{
-			const FItemAddResult AddResult = PlayerInventory->TryAddItem(ItemToGive);
+			//If the whole item fits it's moved over and taken out of the loot source for us, otherwise take what we stacked
+			const FItemAddResult AddResult = PlayerInventory->TryMoveItem(ItemToGive);
 
 			if (AddResult.AmountGiven > 0)
 			{
-				LootSource->ConsumeItem(ItemToGive, AddResult.AmountGiven);
+				if (ItemToGive->OwningInventory == LootSource)
+				{
+					LootSource->ConsumeItem(ItemToGive, AddResult.AmountGiven);
+				}
 			}
 			else
 			{
@@ -839,12 +943,33 @@ void ASurvivalCharacter::LootItem(UItem* ItemToGive)
 			}
 		}
 	}
+	else if (ItemToGive && ItemToGive->InstanceInventory)
+	{
+		//Stand ins only exist on our side, so tell the server which instance we want instead
+		ServerLootItemInstance(ItemToGive->InstanceID);
+	}
 	else
 	{
 		ServerLootItem(ItemToGive);
 	}
 }
 
+void ASurvivalCharacter::ServerLootItemInstance_Implementation(const int32 InstanceID)
+{
+	if (LootSource)
+	{
+		if (UItem* ItemToLoot = LootSource->MaterializeInstance(InstanceID))
+		{
+			LootItem(ItemToLoot);
+		}
+	}
+}
+
+bool ASurvivalCharacter::ServerLootItemInstance_Validate(const int32 InstanceID)
+{
+	return true;
+}
+
 void ASurvivalCharacter::ServerLootItem_Implementation(class UItem* ItemToLoot)
 {
 	LootItem(ItemToLoot);
@@ -857,12 +982,17 @@ bool ASurvivalCharacter::ServerLootItem_Validate(class UItem* ItemToLoot)
 
 void ASurvivalCharacter::PerformInteractionCheck()
 {
-
 	if (GetController() == nullptr)
 	{
 		return;
 	}
 
+	//Don't pile up traces if the last one hasn't come back yet
+	if (InteractionTraceHandle.IsValid() && GetWorld()->IsTraceHandleValid(InteractionTraceHandle, false))
+	{
+		return;
+	}
+
 	InteractionData.LastInteractionCheckTime = GetWorld()->GetTimeSeconds();
 
 	FVector EyesLoc;
@@ -870,37 +1000,63 @@ void ASurvivalCharacter::PerformInteractionCheck()
 
 	GetController()->GetPlayerViewPoint(EyesLoc, EyesRot);
 
-	FVector TraceStart = EyesLoc;
-	FVector TraceEnd = (EyesRot.Vector() * InteractionCheckDistance) + TraceStart;
-	FHitResult TraceHit;
+	UInteractionSubsystem* InteractionSubsystem = GetWorld()->GetSubsystem<UInteractionSubsystem>();
+	UInteractionComponent* Interactable = InteractionSubsystem ? InteractionSubsystem->FindInteractable(EyesLoc, EyesRot.Vector(), InteractionCheckDistance, this) : nullptr;
+
+	if (!Interactable)
+	{
+		CouldntFindInteractable();
+		return;
+	}
 
+	//Found something we're looking at, but we still need to make sure there's nothing in the way
 	FCollisionQueryParams QueryParams;
 	QueryParams.AddIgnoredActor(this);
 
-	if (GetWorld()->LineTraceSingleByChannel(TraceHit, TraceStart, TraceEnd, ECC_Visibility, QueryParams))
+	PendingInteractable = Interactable;
+
+	FTraceDelegate TraceDelegate = FTraceDelegate::CreateUObject(this, &ASurvivalCharacter::OnInteractionTraceDone);
+	InteractionTraceHandle = GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, EyesLoc, Interactable->GetComponentLocation(), ECC_Visibility, QueryParams, FCollisionResponseParams::DefaultResponseParam, &TraceDelegate);
+}
+
+void ASurvivalCharacter::OnInteractionTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum)
+{
+	if (TraceHandle != InteractionTraceHandle)
 	{
-		//Check if we hit an interactable object
-		if (TraceHit.GetActor())
-		{
-			if (UInteractionComponent* InteractionComponent = Cast<UInteractionComponent>(TraceHit.GetActor()->GetComponentByClass(UInteractionComponent::StaticClass())))
-			{
-				float Distance = (TraceStart - TraceHit.ImpactPoint).Size();
-				if (InteractionComponent != GetInteractable() && Distance <= InteractionComponent->InteractionDistance)
-				{
-					FoundNewInteractable(InteractionComponent);
-				}
-				else if (Distance > InteractionComponent->InteractionDistance && GetInteractable())
-				{
-					CouldntFindInteractable();
-				}
+		return;
+	}
 
-				return;
-			}
+	InteractionTraceHandle = FTraceHandle();
+
+	UInteractionComponent* Interactable = PendingInteractable.Get();
+	PendingInteractable.Reset();
+
+	//Anything in the way other than the interactable itself blocks it
+	const bool bBlocked = TraceDatum.OutHits.Num() && TraceDatum.OutHits[0].bBlockingHit && TraceDatum.OutHits[0].GetActor() != (Interactable ? Interactable->GetOwner() : nullptr);
+
+	if (Interactable && Interactable->IsActive() && !bBlocked)
+	{
+		if (Interactable != GetInteractable())
+		{
+			FoundNewInteractable(Interactable);
 		}
 	}
+	else
+	{
+		CouldntFindInteractable();
+	}
+}
 
-	CouldntFindInteractable();
+void ASurvivalCharacter::ServerCheckInteractable()
+{
+	InteractionData.LastInteractionCheckTime = GetWorld()->GetTimeSeconds();
 
+	const UInteractionSubsystem* InteractionSubsystem = GetWorld()->GetSubsystem<UInteractionSubsystem>();
+
+	if (GetInteractable() && (!InteractionSubsystem || !InteractionSubsystem->IsInInteractionRange(GetPawnViewLocation(), GetInteractable())))
+	{
+		CouldntFindInteractable();
+	}
 }
 
 void ASurvivalCharacter::CouldntFindInteractable()
@@ -943,15 +1099,7 @@ void ASurvivalCharacter::BeginInteract()
 {
 	if (!HasAuthority())
 	{
-		ServerBeginInteract();
-	}
-
-	/**As an optimization, the server only checks that we're looking at an item once we begin interacting with it.
-	This saves the server doing a check every tick for an interactable Item. The exception is a non-instant interact.
-	In this case, the server will check every tick for the duration of the interact*/
-	if (HasAuthority())
-	{
-		PerformInteractionCheck();
+		ServerBeginInteract(GetInteractable());
 	}
 
 	InteractionData.bInteractHeld = true;
@@ -998,12 +1146,29 @@ void ASurvivalCharacter::Interact()
 	}
 }
 
-void ASurvivalCharacter::ServerBeginInteract_Implementation()
+void ASurvivalCharacter::ServerBeginInteract_Implementation(UInteractionComponent* Interactable)
 {
+	/**As an optimization, the server only checks what we're interacting with once we begin interacting with it, and only
+	that it's close enough, rather than tracing for it. The exception is a non-instant interact, in which case the server
+	keeps checking we're still in range for the duration of the interact*/
+	const UInteractionSubsystem* InteractionSubsystem = GetWorld()->GetSubsystem<UInteractionSubsystem>();
+
+	if (Interactable && InteractionSubsystem && InteractionSubsystem->IsInInteractionRange(GetPawnViewLocation(), Interactable))
+	{
+		if (Interactable != GetInteractable())
+		{
+			FoundNewInteractable(Interactable);
+		}
+	}
+	else
+	{
+		CouldntFindInteractable();
+	}
+
 	BeginInteract();
 }
 
-bool ASurvivalCharacter::ServerBeginInteract_Validate()
+bool ASurvivalCharacter::ServerBeginInteract_Validate(UInteractionComponent* Interactable)
 {
 	return true;
 }
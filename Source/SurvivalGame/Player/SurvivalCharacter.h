@@ -89,6 +89,7 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 	virtual void Tick(float DeltaTime) override;
 	virtual void Restart() override;
@@ -102,6 +103,8 @@ public:
 	UFUNCTION(BlueprintPure, Category = "Looting")
 	bool IsLooting() const;
 
+	FORCEINLINE class UInventoryComponent* GetLootSource() const { return LootSource; }
+
 protected:
 
 	//Begin being looted by a player
@@ -129,7 +132,12 @@ public:
 	UFUNCTION(Server, Reliable, WithValidation)
 	void ServerLootItem(class UItem* ItemToLoot);
 
-	//How often in seconds to check for an interactable object. Set this to zero if you want to check every tick.
+	/**Loot an item instance from the loot source. See FItemInstance*/
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerLootItemInstance(const int32 InstanceID);
+
+	/**How often in seconds to check for an interactable object. Set this to zero if you want to check every tick. Only the
+	locally controlled player checks, and the server only while it's waiting on a non-instant interact*/
 	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
 	float InteractionCheckFrequency;
 
@@ -137,8 +145,19 @@ public:
 	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
 	float InteractionCheckDistance;
 
+	/**Find the interactable we're looking at from the ones nearby, then trace to it to make sure nothing is in the way. The
+	trace is async, so focus changes the frame after*/
 	void PerformInteractionCheck();
 
+	void OnInteractionTraceDone(const FTraceHandle& TraceHandle, struct FTraceDatum& TraceDatum);
+
+	//[Server] Drop our interactable if we've moved out of range of it
+	void ServerCheckInteractable();
+
+	//The async interaction trace we're waiting on, if any, and what it's checking we can see
+	FTraceHandle InteractionTraceHandle;
+	TWeakObjectPtr<class UInteractionComponent> PendingInteractable;
+
 	void CouldntFindInteractable();
 	void FoundNewInteractable(UInteractionComponent* Interactable);
 
@@ -146,7 +165,7 @@ public:
 	void EndInteract();
 
 	UFUNCTION(Server, Reliable, WithValidation)
-	void ServerBeginInteract();
+	void ServerBeginInteract(class UInteractionComponent* Interactable);
 
 	UFUNCTION(Server, Reliable, WithValidation)
 	void ServerEndInteract();
@@ -264,6 +283,9 @@ protected:
 	UFUNCTION(Server, Reliable)
 		void ServerProcessMeleeHit(const FHitResult& MeleeHit);
 
+	//[Server] damage whatever a melee attack hit, once lag compensation has had its say
+	void ApplyMeleeHit(const bool bValidHit, const FName BoneName, FHitResult MeleeHit);
+
 	UFUNCTION(NetMulticast, Unreliable)
 		void MulticastPlayMeleeFX();
 
@@ -3,9 +3,17 @@
 
 #include "SurvivalGame/Player/SurvivalPlayerController.h"
 #include "SurvivalCharacter.h"
+#include "SurvivalGame/Components/InteractionComponent.h"
+#include "SurvivalGame/Widgets/InteractionWidget.h"
+#include "UObject/ConstructorHelpers.h"
 
 ASurvivalPlayerController::ASurvivalPlayerController()
 {
+	//The card every interactable used to set on its own widget component, so the prompt works without any Blueprint setup
+	static ConstructorHelpers::FClassFinder<UInteractionWidget> InteractionCardClass(TEXT("/Game/UserInterface/Widgets/WBP_InteractionCard"));
+	InteractionWidgetClass = InteractionCardClass.Class;
+
+	InteractionWidget = nullptr;
 }
 
 void ASurvivalPlayerController::SetupInputComponent()
@@ -152,3 +160,66 @@ void ASurvivalPlayerController::StartReload()
 		}
 	}
 }
+
+void ASurvivalPlayerController::ShowInteractionPrompt(UInteractionComponent* Interactable)
+{
+	if (!IsLocalPlayerController() || !Interactable)
+	{
+		return;
+	}
+
+	if (!InteractionWidget && InteractionWidgetClass)
+	{
+		InteractionWidget = CreateWidget<UInteractionWidget>(this, InteractionWidgetClass);
+
+		if (InteractionWidget)
+		{
+			InteractionWidget->SetAlignmentInViewport(FVector2D(0.5f, 0.5f));
+			InteractionWidget->AddToViewport();
+		}
+	}
+
+	if (InteractionWidget)
+	{
+		InteractionWidget->UpdateInteractionWidget(Interactable);
+		InteractionWidget->SetVisibility(ESlateVisibility::HitTestInvisible);
+	}
+}
+
+void ASurvivalPlayerController::HideInteractionPrompt(UInteractionComponent* Interactable)
+{
+	if (InteractionWidget && InteractionWidget->OwningInteractionComponent == Interactable)
+	{
+		InteractionWidget->OwningInteractionComponent = nullptr;
+		InteractionWidget->SetVisibility(ESlateVisibility::Collapsed);
+	}
+}
+
+void ASurvivalPlayerController::RefreshInteractionPrompt(UInteractionComponent* Interactable)
+{
+	if (InteractionWidget && InteractionWidget->OwningInteractionComponent == Interactable)
+	{
+		InteractionWidget->UpdateInteractionWidget(Interactable);
+	}
+}
+
+void ASurvivalPlayerController::PlayerTick(float DeltaTime)
+{
+	Super::PlayerTick(DeltaTime);
+
+	//Keep the prompt over the thing it's for, and hide it when that's behind us
+	if (InteractionWidget && InteractionWidget->OwningInteractionComponent)
+	{
+		FVector2D ScreenLocation;
+
+		if (ProjectWorldLocationToScreen(InteractionWidget->OwningInteractionComponent->GetComponentLocation(), ScreenLocation))
+		{
+			InteractionWidget->SetPositionInViewport(ScreenLocation);
+			InteractionWidget->SetVisibility(ESlateVisibility::HitTestInvisible);
+		}
+		else
+		{
+			InteractionWidget->SetVisibility(ESlateVisibility::Collapsed);
+		}
+	}
+}
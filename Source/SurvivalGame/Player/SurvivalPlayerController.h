@@ -80,4 +80,28 @@ public:
 	void LookUp(float Rate);
 
 	void StartReload();
+
+	//Interaction prompt
+
+	/**Show the interaction prompt for an interactable, over the top of it. There's only ever one prompt, so this replaces
+	whatever it was showing*/
+	void ShowInteractionPrompt(class UInteractionComponent* Interactable);
+
+	//Hide the prompt, if it's still showing this interactable
+	void HideInteractionPrompt(class UInteractionComponent* Interactable);
+
+	//Update the prompt's text, if it's showing this interactable
+	void RefreshInteractionPrompt(class UInteractionComponent* Interactable);
+
+	virtual void PlayerTick(float DeltaTime) override;
+
+protected:
+
+	//The widget used to prompt the player to interact with what they're looking at
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
+		TSubclassOf<class UInteractionWidget> InteractionWidgetClass;
+
+	//Created the first time it's needed, then reused for every interactable
+	UPROPERTY()
+		class UInteractionWidget* InteractionWidget;
 };
@@ -0,0 +1,572 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurvivalGame/Weapons/LagCompensationSubsystem.h"
+#include "SurvivalGame/Player/SurvivalCharacter.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "PhysicsEngine/PhysicsAsset.h"
+#include "PhysicsEngine/SkeletalBodySetup.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Async/ParallelFor.h"
+
+//Where the padding capsules sit. Far enough away that nothing reaches them, near enough that squaring it stays finite
+static const float FarAwayCapsule = 1e15f;
+
+void FLagCompensationHistory::Init(TArray<FLagCompensationHitbox>&& InHitboxes, const int32 InNumFrames)
+{
+	Hitboxes = MoveTemp(InHitboxes);
+	NumLanes = Align(Hitboxes.Num(), 4);
+	NumFrames = FMath::Max(InNumFrames, 2);
+	NewestFrame = INDEX_NONE;
+	NumRecorded = 0;
+
+	FrameTimes.SetNumZeroed(NumFrames);
+	ViewLocations.SetNumZeroed(NumFrames);
+
+	Capsules.SetNumUninitialized(NumFrames * NumComponents * NumLanes);
+
+	for (float& Value : Capsules)
+	{
+		Value = FarAwayCapsule;
+	}
+
+	Radii.SetNumZeroed(NumLanes);
+
+	for (int32 i = 0; i < Hitboxes.Num(); ++i)
+	{
+		Radii[i] = Hitboxes[i].Radius;
+	}
+}
+
+void FLagCompensationHistory::AddFrame(const float Time, const FVector& ViewLocation)
+{
+	NewestFrame = (NewestFrame + 1) % NumFrames;
+	NumRecorded = FMath::Min(NumRecorded + 1, NumFrames);
+
+	FrameTimes[NewestFrame] = Time;
+	ViewLocations[NewestFrame] = ViewLocation;
+}
+
+void FLagCompensationHistory::SetCapsule(const int32 HitboxIndex, const FVector& Start, const FVector& End)
+{
+	float* Frame = Capsules.GetData() + NewestFrame * NumComponents * NumLanes;
+
+	Frame[0 * NumLanes + HitboxIndex] = Start.X;
+	Frame[1 * NumLanes + HitboxIndex] = Start.Y;
+	Frame[2 * NumLanes + HitboxIndex] = Start.Z;
+	Frame[3 * NumLanes + HitboxIndex] = End.X;
+	Frame[4 * NumLanes + HitboxIndex] = End.Y;
+	Frame[5 * NumLanes + HitboxIndex] = End.Z;
+}
+
+float FLagCompensationHistory::GetOldestTime() const
+{
+	return NumRecorded ? FrameTimes[(NewestFrame - NumRecorded + 1 + NumFrames) % NumFrames] : 0.f;
+}
+
+float FLagCompensationHistory::GetNewestTime() const
+{
+	return NumRecorded ? FrameTimes[NewestFrame] : 0.f;
+}
+
+/**
+ * Closest approach of one segment to four capsules at once, each lerped between two frames by Alpha. This is the usual
+ * segment/segment closest points, but without the branches: s and t are each solved for and clamped twice in turn, which
+ * lands on the same answer for everything but nearly parallel segments, where it's still well within a hitbox's radius.
+ * Returns which lanes were hit, as bits, and how far along the shot each one was in OutS.
+ */
+static FORCEINLINE int32 TraceCapsuleLanes(const float* BeforeFrame, const float* AfterFrame, const float* Radii, const int32 Lane, const int32 NumLanes,
+	const VectorRegister4Float& Alpha, const VectorRegister4Float (&ShotStart)[3], const VectorRegister4Float (&ShotDir)[3], const VectorRegister4Float& ShotLengthSq,
+	const VectorRegister4Float& Tolerance, VectorRegister4Float& OutS)
+{
+	const VectorRegister4Float Zero = VectorZeroFloat();
+	const VectorRegister4Float One = VectorOneFloat();
+	const VectorRegister4Float Small = VectorSetFloat1(KINDA_SMALL_NUMBER);
+
+	VectorRegister4Float CapsuleStart[3];
+	VectorRegister4Float CapsuleDir[3];
+
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		const float* BeforeStart = BeforeFrame + Axis * NumLanes + Lane;
+		const float* BeforeEnd = BeforeFrame + (Axis + 3) * NumLanes + Lane;
+		const float* AfterStart = AfterFrame + Axis * NumLanes + Lane;
+		const float* AfterEnd = AfterFrame + (Axis + 3) * NumLanes + Lane;
+
+		const VectorRegister4Float Start = VectorLoadAligned(BeforeStart);
+		const VectorRegister4Float End = VectorLoadAligned(BeforeEnd);
+
+		CapsuleStart[Axis] = VectorMultiplyAdd(VectorSubtract(VectorLoadAligned(AfterStart), Start), Alpha, Start);
+		CapsuleDir[Axis] = VectorSubtract(VectorMultiplyAdd(VectorSubtract(VectorLoadAligned(AfterEnd), End), Alpha, End), CapsuleStart[Axis]);
+	}
+
+	//Shot is P1 + D1 * s, capsule is P2 + D2 * t, R is P1 - P2
+	VectorRegister4Float R[3];
+
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		R[Axis] = VectorSubtract(ShotStart[Axis], CapsuleStart[Axis]);
+	}
+
+	const auto Dot = [](const VectorRegister4Float (&A)[3], const VectorRegister4Float (&B)[3])
+	{
+		return VectorMultiplyAdd(A[2], B[2], VectorMultiplyAdd(A[1], B[1], VectorMultiply(A[0], B[0])));
+	};
+
+	const auto Clamp01 = [&Zero, &One](const VectorRegister4Float& Value)
+	{
+		return VectorMin(VectorMax(Value, Zero), One);
+	};
+
+	const VectorRegister4Float B = Dot(ShotDir, CapsuleDir);
+	const VectorRegister4Float C = Dot(ShotDir, R);
+	const VectorRegister4Float E = VectorMax(Dot(CapsuleDir, CapsuleDir), Small);
+	const VectorRegister4Float F = Dot(CapsuleDir, R);
+
+	//Spheres have no length, so E is tiny and t clamps to an end, which is fine as both ends are the same
+	const VectorRegister4Float Denom = VectorMax(VectorSubtract(VectorMultiply(ShotLengthSq, E), VectorMultiply(B, B)), Small);
+
+	VectorRegister4Float S = Clamp01(VectorDivide(VectorSubtract(VectorMultiply(B, F), VectorMultiply(C, E)), Denom));
+	VectorRegister4Float T = Clamp01(VectorDivide(VectorMultiplyAdd(B, S, F), E));
+	S = Clamp01(VectorDivide(VectorSubtract(VectorMultiply(B, T), C), ShotLengthSq));
+	T = Clamp01(VectorDivide(VectorMultiplyAdd(B, S, F), E));
+	S = Clamp01(VectorDivide(VectorSubtract(VectorMultiply(B, T), C), ShotLengthSq));
+
+	VectorRegister4Float DistanceSq = Zero;
+
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		const VectorRegister4Float Delta = VectorSubtract(VectorMultiplyAdd(ShotDir[Axis], S, R[Axis]), VectorMultiply(CapsuleDir[Axis], T));
+		DistanceSq = VectorMultiplyAdd(Delta, Delta, DistanceSq);
+	}
+
+	const VectorRegister4Float HitRadius = VectorAdd(VectorLoadAligned(Radii + Lane), Tolerance);
+
+	OutS = S;
+	return VectorMaskBits(VectorCompareLE(DistanceSq, VectorMultiply(HitRadius, HitRadius)));
+}
+
+int32 FLagCompensationHistory::TraceAtTime(const float Time, const FVector& Start, const FVector& End, const float Tolerance, float& OutDistance) const
+{
+	if (!NumRecorded || !Hitboxes.Num())
+	{
+		return INDEX_NONE;
+	}
+
+	int32 BeforeFrame;
+	int32 AfterFrame;
+	float Alpha;
+	FindFrames(Time, BeforeFrame, AfterFrame, Alpha);
+
+	const float* BeforeCapsules = Capsules.GetData() + BeforeFrame * NumComponents * NumLanes;
+	const float* AfterCapsules = Capsules.GetData() + AfterFrame * NumComponents * NumLanes;
+
+	const FVector3f ShotStart(Start);
+	const FVector3f ShotDir(End - Start);
+	const float ShotLengthSq = FMath::Max(ShotDir.SizeSquared(), KINDA_SMALL_NUMBER);
+
+	const VectorRegister4Float ShotStartLanes[3] = { VectorSetFloat1(ShotStart.X), VectorSetFloat1(ShotStart.Y), VectorSetFloat1(ShotStart.Z) };
+	const VectorRegister4Float ShotDirLanes[3] = { VectorSetFloat1(ShotDir.X), VectorSetFloat1(ShotDir.Y), VectorSetFloat1(ShotDir.Z) };
+	const VectorRegister4Float ShotLengthSqLanes = VectorSetFloat1(ShotLengthSq);
+	const VectorRegister4Float AlphaLanes = VectorSetFloat1(Alpha);
+	const VectorRegister4Float ToleranceLanes = VectorSetFloat1(Tolerance);
+
+	int32 HitIndex = INDEX_NONE;
+	float HitS = TNumericLimits<float>::Max();
+
+	for (int32 Lane = 0; Lane < NumLanes; Lane += 4)
+	{
+		VectorRegister4Float S;
+		const int32 HitLanes = TraceCapsuleLanes(BeforeCapsules, AfterCapsules, Radii.GetData(), Lane, NumLanes, AlphaLanes, ShotStartLanes, ShotDirLanes, ShotLengthSqLanes, ToleranceLanes, S);
+
+		//Misses are by far the common case, so only pull the lanes apart when something was hit
+		if (HitLanes)
+		{
+			alignas(16) float LaneS[4];
+			VectorStoreAligned(S, LaneS);
+
+			for (int32 i = 0; i < 4; ++i)
+			{
+				if ((HitLanes & (1 << i)) && LaneS[i] < HitS)
+				{
+					HitS = LaneS[i];
+					HitIndex = Lane + i;
+				}
+			}
+		}
+	}
+
+	OutDistance = HitIndex != INDEX_NONE ? HitS * FMath::Sqrt(ShotLengthSq) : TNumericLimits<float>::Max();
+
+	return HitIndex;
+}
+
+FVector FLagCompensationHistory::GetViewLocationAtTime(const float Time) const
+{
+	if (!NumRecorded)
+	{
+		return FVector::ZeroVector;
+	}
+
+	int32 BeforeFrame;
+	int32 AfterFrame;
+	float Alpha;
+	FindFrames(Time, BeforeFrame, AfterFrame, Alpha);
+
+	return FMath::Lerp(ViewLocations[BeforeFrame], ViewLocations[AfterFrame], Alpha);
+}
+
+void FLagCompensationHistory::FindFrames(const float Time, int32& OutBeforeFrame, int32& OutAfterFrame, float& OutAlpha) const
+{
+	//Walk back from the newest frame until we find the two frames either side of the time we want
+	OutAfterFrame = NewestFrame;
+	OutBeforeFrame = NewestFrame;
+
+	for (int32 i = 1; i < NumRecorded && FrameTimes[OutBeforeFrame] > Time; ++i)
+	{
+		OutAfterFrame = OutBeforeFrame;
+		OutBeforeFrame = (OutBeforeFrame - 1 + NumFrames) % NumFrames;
+	}
+
+	const float FrameGap = FrameTimes[OutAfterFrame] - FrameTimes[OutBeforeFrame];
+	OutAlpha = FrameGap > KINDA_SMALL_NUMBER ? FMath::Clamp((Time - FrameTimes[OutBeforeFrame]) / FrameGap, 0.f, 1.f) : 0.f;
+}
+
+ULagCompensationSubsystem::ULagCompensationSubsystem()
+{
+	RecordInterval = 1.f / 30.f;
+	HistoryFrames = 32;
+	MaxRewindTime = 0.5f;
+	HitTolerance = 10.f;
+	MaxShotOriginError = 150.f;
+	MaxHitboxesPerCharacter = 24;
+	MinHitsToVerifyInParallel = 8;
+
+	TimeSinceRecord = 0.f;
+}
+
+void ULagCompensationSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	//Check this frame's hits before recording a new frame, so they see the same history they'd have seen when they arrived
+	if (QueuedHits.Num())
+	{
+		VerifyQueuedHits();
+	}
+
+	//Hits get lerped between frames, so the pose doesn't need refreshing every tick
+	TimeSinceRecord += DeltaTime;
+
+	if (!Histories.Num() || TimeSinceRecord < RecordInterval)
+	{
+		return;
+	}
+
+	TimeSinceRecord = 0.f;
+
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	for (auto& CharacterHistory : Histories)
+	{
+		const USkeletalMeshComponent* Mesh = CharacterHistory.Key->GetMesh();
+		const TArray<FLagCompensationHitbox>& Hitboxes = CharacterHistory.Value.GetHitboxes();
+
+		CharacterHistory.Value.AddFrame(Now, CharacterHistory.Key->GetPawnViewLocation());
+
+		for (int32 i = 0; i < Hitboxes.Num(); ++i)
+		{
+			const FTransform BoneTransform = Mesh->GetBoneTransform(Hitboxes[i].BoneIndex);
+
+			CharacterHistory.Value.SetCapsule(i, BoneTransform.TransformPosition(Hitboxes[i].LocalStart), BoneTransform.TransformPosition(Hitboxes[i].LocalEnd));
+		}
+	}
+}
+
+TStatId ULagCompensationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(ULagCompensationSubsystem, STATGROUP_Tickables);
+}
+
+void ULagCompensationSubsystem::RegisterCharacter(ASurvivalCharacter* Character)
+{
+	if (Character && Character->GetMesh())
+	{
+		TArray<FLagCompensationHitbox> Hitboxes = BuildHitboxes(Character->GetMesh(), MaxHitboxesPerCharacter);
+
+		if (Hitboxes.Num())
+		{
+			Histories.FindOrAdd(Character).Init(MoveTemp(Hitboxes), HistoryFrames);
+		}
+	}
+}
+
+void ULagCompensationSubsystem::UnregisterCharacter(ASurvivalCharacter* Character)
+{
+	Histories.Remove(Character);
+}
+
+void ULagCompensationSubsystem::QueueHit(const ASurvivalCharacter* Shooter, const ASurvivalCharacter* HitCharacter, const float Time, const FVector& Start, const FVector& End, const float Radius, const FName BoneName, FOnLagCompensatedHitVerified&& OnVerified)
+{
+	FLagCompensationHitRequest& Request = QueuedHits.AddDefaulted_GetRef();
+	Request.HitCharacter = HitCharacter;
+	Request.Shooter = Shooter;
+	Request.Time = Time;
+	Request.Start = Start;
+	Request.End = End;
+	Request.Radius = Radius;
+	Request.BoneName = BoneName;
+	Request.OnVerified = MoveTemp(OnVerified);
+}
+
+void ULagCompensationSubsystem::VerifyQueuedHits()
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_LagCompensation_VerifyQueuedHits);
+
+	//Take the queue first, so anything queued by the callbacks waits for next frame instead of being missed
+	TArray<FLagCompensationHitRequest> Hits = MoveTemp(QueuedHits);
+
+	//Look everything up on the game thread, so the parallel pass only reads the histories
+	for (FLagCompensationHitRequest& Hit : Hits)
+	{
+		Hit.Target = Hit.HitCharacter.Get();
+		Hit.IgnoreCharacter = Hit.Shooter.Get();
+
+		const FLagCompensationHistory* History = Histories.Find(Hit.Target);
+		Hit.bTracked = History && History->HasHistory();
+	}
+
+	ParallelFor(Hits.Num(), [this, &Hits](const int32 Index)
+	{
+		FLagCompensationHitRequest& Hit = Hits[Index];
+
+		//Tracing everyone rather than just the target means a hit through someone else standing in the way doesn't count
+		if (Hit.bTracked)
+		{
+			FName BoneName;
+			const ASurvivalCharacter* FirstHit = TraceCharacters(Hit.Time, Hit.Start, Hit.End, Hit.Radius, BoneName, Hit.IgnoreCharacter);
+
+			Hit.bValidHit = FirstHit == Hit.Target;
+
+			if (Hit.bValidHit)
+			{
+				Hit.BoneName = BoneName;
+			}
+		}
+	}, Hits.Num() < MinHitsToVerifyInParallel ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	for (FLagCompensationHitRequest& Hit : Hits)
+	{
+		Hit.OnVerified.ExecuteIfBound(Hit.bValidHit, Hit.BoneName);
+	}
+}
+
+bool ULagCompensationSubsystem::IsShotOriginValid(const ASurvivalCharacter* Shooter, const float Time, const FVector& Origin) const
+{
+	if (!Shooter)
+	{
+		return false;
+	}
+
+	const float MaxErrorSq = FMath::Square(MaxShotOriginError);
+
+	if (FVector::DistSquared(Shooter->GetPawnViewLocation(), Origin) <= MaxErrorSq)
+	{
+		return true;
+	}
+
+	//The shooter may have moved since they fired, so try where they were then
+	const FLagCompensationHistory* History = Histories.Find(Shooter);
+
+	return History && History->HasHistory() && FVector::DistSquared(History->GetViewLocationAtTime(ClampRewindTime(*History, Time)), Origin) <= MaxErrorSq;
+}
+
+const ASurvivalCharacter* ULagCompensationSubsystem::TraceCharacters(const float Time, const FVector& Start, const FVector& End, const float Radius, FName& OutBoneName, const ASurvivalCharacter* IgnoreCharacter /*= nullptr*/) const
+{
+	const ASurvivalCharacter* HitCharacter = nullptr;
+	float HitDistance = TNumericLimits<float>::Max();
+
+	for (const auto& CharacterHistory : Histories)
+	{
+		if (CharacterHistory.Key == IgnoreCharacter || !CharacterHistory.Value.HasHistory())
+		{
+			continue;
+		}
+
+		float Distance = 0.f;
+		const int32 HitIndex = CharacterHistory.Value.TraceAtTime(ClampRewindTime(CharacterHistory.Value, Time), Start, End, Radius + HitTolerance, Distance);
+
+		if (HitIndex != INDEX_NONE && Distance < HitDistance)
+		{
+			HitDistance = Distance;
+			HitCharacter = CharacterHistory.Key;
+			OutBoneName = CharacterHistory.Value.GetHitboxes()[HitIndex].BoneName;
+		}
+	}
+
+	return HitCharacter;
+}
+
+float ULagCompensationSubsystem::ClampRewindTime(const FLagCompensationHistory& History, const float Time) const
+{
+	//Never go back further than we're willing to, even if the buffer goes back further
+	const float Now = GetWorld()->GetTimeSeconds();
+	return FMath::Clamp(Time, FMath::Max(Now - MaxRewindTime, History.GetOldestTime()), History.GetNewestTime());
+}
+
+TArray<FLagCompensationHitbox> ULagCompensationSubsystem::BuildHitboxes(const USkeletalMeshComponent* Mesh, const int32 MaxHitboxes)
+{
+	TArray<FLagCompensationHitbox> Hitboxes;
+
+	const UPhysicsAsset* PhysicsAsset = Mesh ? Mesh->GetPhysicsAsset() : nullptr;
+
+	if (!PhysicsAsset)
+	{
+		return Hitboxes;
+	}
+
+	for (const USkeletalBodySetup* BodySetup : PhysicsAsset->SkeletalBodySetups)
+	{
+		const int32 BoneIndex = BodySetup ? Mesh->GetBoneIndex(BodySetup->BoneName) : INDEX_NONE;
+
+		if (BoneIndex == INDEX_NONE)
+		{
+			continue;
+		}
+
+		FLagCompensationHitbox Hitbox;
+		Hitbox.BoneName = BodySetup->BoneName;
+		Hitbox.BoneIndex = BoneIndex;
+
+		for (const FKSphylElem& Sphyl : BodySetup->AggGeom.SphylElems)
+		{
+			const FTransform SphylTransform = Sphyl.GetTransform();
+			Hitbox.LocalStart = SphylTransform.TransformPosition(FVector(0.f, 0.f, -Sphyl.Length * 0.5f));
+			Hitbox.LocalEnd = SphylTransform.TransformPosition(FVector(0.f, 0.f, Sphyl.Length * 0.5f));
+			Hitbox.Radius = Sphyl.Radius;
+			Hitboxes.Add(Hitbox);
+		}
+
+		for (const FKSphereElem& Sphere : BodySetup->AggGeom.SphereElems)
+		{
+			Hitbox.LocalStart = Hitbox.LocalEnd = Sphere.Center;
+			Hitbox.Radius = Sphere.Radius;
+			Hitboxes.Add(Hitbox);
+		}
+
+		//Boxes become a capsule down their longest side, as wide as the box is
+		for (const FKBoxElem& Box : BodySetup->AggGeom.BoxElems)
+		{
+			const FVector Extents(Box.X, Box.Y, Box.Z);
+			const int32 LongestAxis = Extents.X >= Extents.Y && Extents.X >= Extents.Z ? 0 : (Extents.Y >= Extents.Z ? 1 : 2);
+
+			Hitbox.Radius = FMath::Max(Extents[(LongestAxis + 1) % 3], Extents[(LongestAxis + 2) % 3]) * 0.5f;
+
+			FVector Axis = FVector::ZeroVector;
+			Axis[LongestAxis] = FMath::Max(Extents[LongestAxis] * 0.5f - Hitbox.Radius, 0.f);
+
+			const FVector RotatedAxis = Box.Rotation.RotateVector(Axis);
+			Hitbox.LocalStart = Box.Center - RotatedAxis;
+			Hitbox.LocalEnd = Box.Center + RotatedAxis;
+			Hitboxes.Add(Hitbox);
+		}
+
+		if (Hitboxes.Num() >= MaxHitboxes)
+		{
+			Hitboxes.SetNum(MaxHitboxes);
+			break;
+		}
+	}
+
+	return Hitboxes;
+}
+
+#if !UE_BUILD_SHIPPING
+/**Fill histories for a lot of made up characters, then time rewinding shots against them. Reports the cost of checking one hit,
+and of checking one shot against every character. Usage: Survival.LagCompensation.Benchmark [Characters] [Iterations]*/
+static void BenchmarkLagCompensation(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 NumCharacters = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100;
+	const int32 Iterations = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 10000;
+
+	const ULagCompensationSubsystem* Settings = GetDefault<ULagCompensationSubsystem>();
+	const int32 NumHitboxes = 16;
+	const float TickInterval = Settings->RecordInterval;
+
+	FRandomStream Stream(1234);
+
+	TArray<FLagCompensationHistory> Histories;
+	Histories.SetNum(NumCharacters);
+
+	//Characters spread over a 100m square, each a column of capsules roughly the shape of a person
+	for (FLagCompensationHistory& History : Histories)
+	{
+		TArray<FLagCompensationHitbox> Hitboxes;
+		Hitboxes.SetNum(NumHitboxes);
+
+		for (int32 i = 0; i < NumHitboxes; ++i)
+		{
+			Hitboxes[i].LocalStart = FVector(0.f, 0.f, i * 10.f);
+			Hitboxes[i].LocalEnd = FVector(0.f, 0.f, i * 10.f + 8.f);
+			Hitboxes[i].Radius = 8.f;
+		}
+
+		History.Init(MoveTemp(Hitboxes), Settings->HistoryFrames);
+
+		FVector Location(Stream.FRandRange(-5000.f, 5000.f), Stream.FRandRange(-5000.f, 5000.f), 0.f);
+
+		for (int32 Frame = 0; Frame < Settings->HistoryFrames; ++Frame)
+		{
+			Location += FVector(Stream.FRandRange(-20.f, 20.f), Stream.FRandRange(-20.f, 20.f), 0.f);
+
+			History.AddFrame(Frame * TickInterval, Location);
+
+			for (int32 i = 0; i < NumHitboxes; ++i)
+			{
+				History.SetCapsule(i, Location + History.GetHitboxes()[i].LocalStart, Location + History.GetHitboxes()[i].LocalEnd);
+			}
+		}
+	}
+
+	const float NewestTime = (Settings->HistoryFrames - 1) * TickInterval;
+	int32 Hits = 0;
+	float Distance = 0.f;
+
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		const FLagCompensationHistory& History = Histories[i % NumCharacters];
+		const FVector Start(Stream.FRandRange(-5000.f, 5000.f), Stream.FRandRange(-5000.f, 5000.f), 100.f);
+		const FVector End = Start + Stream.GetUnitVector() * 10000.f;
+
+		Hits += History.TraceAtTime(Stream.FRandRange(0.f, NewestTime), Start, End, Settings->HitTolerance, Distance) != INDEX_NONE;
+	}
+	const double SingleTime = FPlatformTime::Seconds() - StartTime;
+
+	const int32 AllIterations = FMath::Max(1, Iterations / NumCharacters);
+
+	StartTime = FPlatformTime::Seconds();
+	for (int32 i = 0; i < AllIterations; ++i)
+	{
+		const FVector Start(Stream.FRandRange(-5000.f, 5000.f), Stream.FRandRange(-5000.f, 5000.f), 100.f);
+		const FVector End = Start + Stream.GetUnitVector() * 10000.f;
+		const float Time = Stream.FRandRange(0.f, NewestTime);
+
+		for (const FLagCompensationHistory& History : Histories)
+		{
+			Hits += History.TraceAtTime(Time, Start, End, Settings->HitTolerance, Distance) != INDEX_NONE;
+		}
+	}
+	const double AllTime = FPlatformTime::Seconds() - StartTime;
+
+	UE_LOG(LogTemp, Display, TEXT("Lag compensation, %d characters, %d hitboxes, %d frames: one hit %.3fus | one shot against every character %.3fus (%d)"),
+		NumCharacters, NumHitboxes, Settings->HistoryFrames,
+		SingleTime * 1e6 / Iterations, AllTime * 1e6 / AllIterations, Hits);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkLagCompensationCmd(
+	TEXT("Survival.LagCompensation.Benchmark"),
+	TEXT("Time rewinding hits against made up characters. Usage: Survival.LagCompensation.Benchmark [Characters] [Iterations]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkLagCompensation));
+#endif
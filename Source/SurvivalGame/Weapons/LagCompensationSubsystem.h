@@ -0,0 +1,177 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "LagCompensationSubsystem.generated.h"
+
+class ASurvivalCharacter;
+
+//One capsule of a character's hitbox, as a segment and radius relative to the bone it follows
+struct FLagCompensationHitbox
+{
+	FName BoneName;
+	int32 BoneIndex = INDEX_NONE;
+	FVector LocalStart = FVector::ZeroVector;
+	FVector LocalEnd = FVector::ZeroVector;
+	float Radius = 0.f;
+};
+
+/**
+ * A fixed number of frames of one character's hitboxes, written round and round like a ring buffer. Nothing is allocated
+ * after Init, and tracing against a moment in the past costs at most one pass over the frames plus one over the hitboxes.
+ * Capsules are kept as floats, one array per component padded to a multiple of four, so they can be tested four at a time.
+ */
+class SURVIVALGAME_API FLagCompensationHistory
+{
+public:
+
+	void Init(TArray<FLagCompensationHitbox>&& InHitboxes, const int32 InNumFrames);
+
+	//Start a new frame, overwriting the oldest one if the buffer is full. Fill it in with SetCapsule
+	void AddFrame(const float Time, const FVector& ViewLocation);
+
+	//Set where a hitbox's capsule is in the newest frame, in world space
+	void SetCapsule(const int32 HitboxIndex, const FVector& Start, const FVector& End);
+
+	/**Put the hitboxes back where they were at the given time and trace a segment against them. Returns the index of the
+	closest hitbox it passes within Tolerance of, or INDEX_NONE*/
+	int32 TraceAtTime(const float Time, const FVector& Start, const FVector& End, const float Tolerance, float& OutDistance) const;
+
+	//Where the character was looking from at the given time
+	FVector GetViewLocationAtTime(const float Time) const;
+
+	const TArray<FLagCompensationHitbox>& GetHitboxes() const { return Hitboxes; }
+
+	float GetOldestTime() const;
+	float GetNewestTime() const;
+
+	bool HasHistory() const { return NumRecorded > 0; }
+
+private:
+
+	enum { NumComponents = 6 };
+
+	//Find the two frames either side of Time, and how far between them it is
+	void FindFrames(const float Time, int32& OutBeforeFrame, int32& OutAfterFrame, float& OutAlpha) const;
+
+	TArray<FLagCompensationHitbox> Hitboxes;
+
+	//Hitboxes.Num() rounded up to a multiple of four. Padding capsules sit far away so they never get hit
+	int32 NumLanes = 0;
+
+	/**NumFrames times, and NumFrames frames of capsules. Each frame is StartX, StartY, StartZ, EndX, EndY, EndZ, with
+	NumLanes floats each*/
+	TArray<float> FrameTimes;
+	TArray<FVector> ViewLocations;
+	TArray<float, TAlignedHeapAllocator<16>> Capsules;
+	TArray<float, TAlignedHeapAllocator<16>> Radii;
+
+	int32 NumFrames = 0;
+	int32 NewestFrame = INDEX_NONE;
+	int32 NumRecorded = 0;
+};
+
+//Told whether a queued hit held up, and which bone it found was hit
+DECLARE_DELEGATE_TwoParams(FOnLagCompensatedHitVerified, bool /*bValidHit*/, FName /*BoneName*/);
+
+//A hit waiting to be checked at the end of the frame
+struct FLagCompensationHitRequest
+{
+	TWeakObjectPtr<const ASurvivalCharacter> HitCharacter;
+	TWeakObjectPtr<const ASurvivalCharacter> Shooter;
+	float Time = 0.f;
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+	float Radius = 0.f;
+	FOnLagCompensatedHitVerified OnVerified;
+
+	//Filled in by the verify pass. The characters are looked up on the game thread, so the parallel pass only compares pointers
+	const ASurvivalCharacter* Target = nullptr;
+	const ASurvivalCharacter* IgnoreCharacter = nullptr;
+	bool bTracked = false;
+	bool bValidHit = true;
+	FName BoneName;
+};
+
+/**
+ * [Server] Remembers where every character's hitboxes were over the last fraction of a second, so hits can be checked against
+ * what the shooter actually saw instead of where the target is now, or just trusted.
+ */
+UCLASS(Config = Game)
+class SURVIVALGAME_API ULagCompensationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	ULagCompensationSubsystem();
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	void RegisterCharacter(ASurvivalCharacter* Character);
+	void UnregisterCharacter(ASurvivalCharacter* Character);
+
+	/**Queue a hit to be checked against where every character was at the given server time, clamped to how far back we 
+	remember. The hit holds up if HitCharacter is the first character the shot reaches, not counting the shooter. Radius is 
+	the radius of the shot, ie the sweep for a melee attack. If HitCharacter isn't tracked we can't say, so the hit is allowed 
+	and BoneName is passed back. Everything queued during a frame is checked together, spread over the task graph, and then 
+	OnVerified is called for each of them on the game thread in the order they were queued*/
+	void QueueHit(const ASurvivalCharacter* Shooter, const ASurvivalCharacter* HitCharacter, const float Time, const FVector& Start, const FVector& End, const float Radius, const FName BoneName, FOnLagCompensatedHitVerified&& OnVerified);
+
+	/**Whether a shot or swing could have started from Origin. It has to be within MaxShotOriginError of where the shooter is 
+	looking from now, or was looking from at the given time. Checked before queueing a hit, so clients can't report a trace 
+	that starts right next to their target*/
+	bool IsShotOriginValid(const ASurvivalCharacter* Shooter, const float Time, const FVector& Origin) const;
+
+	/**Trace against every tracked character but IgnoreCharacter at the given time, and return the closest one hit along with 
+	the bone. Characters we don't track can't be hit*/
+	const ASurvivalCharacter* TraceCharacters(const float Time, const FVector& Start, const FVector& End, const float Radius, FName& OutBoneName, const ASurvivalCharacter* IgnoreCharacter = nullptr) const;
+
+	//How often the hitboxes are refreshed from the characters' poses, in seconds
+	UPROPERTY(Config)
+	float RecordInterval;
+
+	//How many frames of history each character keeps. Should cover MaxRewindTime at RecordInterval
+	UPROPERTY(Config)
+	int32 HistoryFrames;
+
+	//How far back a hit can be rewound to, in seconds. Anything older is checked against the oldest frame
+	UPROPERTY(Config)
+	float MaxRewindTime;
+
+	//Extra distance a shot can miss a hitbox by and still count, to cover interpolation and quantization
+	UPROPERTY(Config)
+	float HitTolerance;
+
+	//How far a shot's reported origin can be from where the shooter was looking from, to cover the camera and movement
+	UPROPERTY(Config)
+	float MaxShotOriginError;
+
+	//Characters with more bodies than this in their physics asset only get the first ones tracked
+	UPROPERTY(Config)
+	int32 MaxHitboxesPerCharacter;
+
+	//Below this many queued hits they're checked on the game thread, as it isn't worth waking the workers
+	UPROPERTY(Config)
+	int32 MinHitsToVerifyInParallel;
+
+	//Build a character's hitboxes from the capsules, spheres and boxes in its physics asset
+	static TArray<FLagCompensationHitbox> BuildHitboxes(const class USkeletalMeshComponent* Mesh, const int32 MaxHitboxes);
+
+private:
+
+	float ClampRewindTime(const FLagCompensationHistory& History, const float Time) const;
+
+	//Check every queued hit against the history as it is now, then hand out the results
+	void VerifyQueuedHits();
+
+	TArray<FLagCompensationHitRequest> QueuedHits;
+
+	TMap<const ASurvivalCharacter*, FLagCompensationHistory> Histories;
+
+	float TimeSinceRecord;
+
+};
@@ -15,11 +15,14 @@
 #include "Sound/SoundCue.h"
 
 #include "Net/UnrealNetwork.h"
+#include "Net/Core/PushModel/PushModel.h"
 #include "SurvivalGame/Items/EquippableItem.h"
 #include "SurvivalGame/Items/AmmoItem.h"
 #include "DrawDebugHelpers.h"
 
 #include "Components/SkeletalMeshComponent.h"
+#include "GameFramework/GameStateBase.h"
+#include "SurvivalGame/Weapons/LagCompensationSubsystem.h"
 
 // Sets default values
 AWeapon::AWeapon()
@@ -45,6 +48,11 @@ AWeapon::AWeapon()
 	CurrentAmmoInClip = 0;
 	BurstCounter = 0;
 	LastFireTime = 0.0f;
+	CurrentShotTime = 0.f;
+	ShotBatchWindow = 0.f;
+	ShotSpacingTolerance = 0.05f;
+	ShotBudget = 0.f;
+	ShotBudgetTime = 0.f;
 
 	ADSTime = 0.5f;
 	RecoilResetSpeed = 5.f;
@@ -62,9 +70,15 @@ void AWeapon::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeP
 
 	DOREPLIFETIME(AWeapon, PawnOwner);
 
-	DOREPLIFETIME_CONDITION(AWeapon, CurrentAmmoInClip, COND_OwnerOnly);
-	DOREPLIFETIME_CONDITION(AWeapon, BurstCounter, COND_SkipOwner);
-	DOREPLIFETIME_CONDITION(AWeapon, bPendingReload, COND_SkipOwner);
+	FDoRepLifetimeParams PushParams;
+	PushParams.bIsPushBased = true;
+
+	PushParams.Condition = COND_OwnerOnly;
+	DOREPLIFETIME_WITH_PARAMS_FAST(AWeapon, CurrentAmmoInClip, PushParams);
+
+	PushParams.Condition = COND_SkipOwner;
+	DOREPLIFETIME_WITH_PARAMS_FAST(AWeapon, BurstCounter, PushParams);
+	DOREPLIFETIME_WITH_PARAMS_FAST(AWeapon, bPendingReload, PushParams);
 	DOREPLIFETIME_CONDITION(AWeapon, Item, COND_InitialOnly);
 }
 
@@ -96,6 +110,7 @@ void AWeapon::UseClipAmmo()
 	if (HasAuthority())
 	{
 		--CurrentAmmoInClip;
+		MARK_PROPERTY_DIRTY_FROM_NAME(AWeapon, CurrentAmmoInClip, this);
 	}
 }
 
@@ -175,6 +190,7 @@ void AWeapon::OnUnEquip()
 	{
 		StopWeaponAnimation(ReloadAnim);
 		bPendingReload = false;
+		MARK_PROPERTY_DIRTY_FROM_NAME(AWeapon, bPendingReload, this);
 
 		GetWorldTimerManager().ClearTimer(TimerHandle_StopReload);
 		GetWorldTimerManager().ClearTimer(TimerHandle_ReloadWeapon);
@@ -222,6 +238,12 @@ void AWeapon::StartFire()
 
 void AWeapon::StopFire()
 {
+	//Don't leave the last few shots of a burst waiting on the batch window
+	if (PendingShotTimes.Num())
+	{
+		FlushShots();
+	}
+
 	if ((HasAuthority()) && PawnOwner && PawnOwner->IsLocallyControlled())
 	{
 		ServerStopFire();
@@ -247,6 +269,7 @@ void AWeapon::StartReload(bool bFromReplication /*= false*/)
 	{
 		//GEngine->AddOnScreenDebugMessage(-1, 15.0f, FColor::Green, "yeet2");
 		bPendingReload = true;
+		MARK_PROPERTY_DIRTY_FROM_NAME(AWeapon, bPendingReload, this);
 		DetermineWeaponState();
 
 		float AnimDuration = PlayWeaponAnimation(ReloadAnim);
@@ -274,6 +297,7 @@ void AWeapon::StopReload()
 	if (CurrentState == EWeaponState::Reloading)
 	{
 		bPendingReload = false;
+		MARK_PROPERTY_DIRTY_FROM_NAME(AWeapon, bPendingReload, this);
 		DetermineWeaponState();
 		StopWeaponAnimation(ReloadAnim);
 	}
@@ -286,6 +310,7 @@ void AWeapon::ReloadWeapon()
 	if (ClipDelta > 0)
 	{
 		CurrentAmmoInClip += ClipDelta;
+		MARK_PROPERTY_DIRTY_FROM_NAME(AWeapon, CurrentAmmoInClip, this);
 		ConsumeAmmo(ClipDelta);
 	}
 	else
@@ -377,6 +402,12 @@ void AWeapon::ClientStartReload_Implementation()
 	StartReload();
 }
 
+void AWeapon::ClientSetAmmoInClip_Implementation(const int32 AmmoInClip)
+{
+	//Shots we've fired but not sent yet will still be taken off on the server
+	CurrentAmmoInClip = FMath::Max(AmmoInClip - PendingShotTimes.Num(), 0);
+}
+
 void AWeapon::ServerStartFire_Implementation()
 {
 	StartFire();
@@ -547,6 +578,82 @@ void AWeapon::StopSimulatingWeaponFire()
 	}
 }
 
+bool FSurvivalShotReport::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	//Most shots hit the world, so only send the player and bone when we actually hit someone
+	uint8 bHitPlayer = HitPlayer != nullptr;
+	uint8 bHasBone = BoneIndex != INDEX_NONE;
+
+	Ar.SerializeBits(&bHitPlayer, 1);
+	Ar.SerializeBits(&bHasBone, 1);
+
+	bOutSuccess = true;
+
+	bool bSuccess = true;
+	Origin.NetSerialize(Ar, Map, bSuccess);
+	bOutSuccess &= bSuccess;
+
+	Direction.NetSerialize(Ar, Map, bSuccess);
+	bOutSuccess &= bSuccess;
+
+	ImpactPoint.NetSerialize(Ar, Map, bSuccess);
+	bOutSuccess &= bSuccess;
+
+	if (bHitPlayer)
+	{
+		UObject* HitObject = HitPlayer;
+		bOutSuccess &= Map->SerializeObject(Ar, ASurvivalCharacter::StaticClass(), HitObject);
+
+		if (Ar.IsLoading())
+		{
+			HitPlayer = Cast<ASurvivalCharacter>(HitObject);
+		}
+	}
+	else if (Ar.IsLoading())
+	{
+		HitPlayer = nullptr;
+	}
+
+	if (bHasBone)
+	{
+		Ar << BoneIndex;
+	}
+	else if (Ar.IsLoading())
+	{
+		BoneIndex = INDEX_NONE;
+	}
+
+	Ar << ShotTime;
+
+	return true;
+}
+
+FHitResult FSurvivalShotReport::ToHitResult(const float TraceDistance) const
+{
+	FHitResult Hit(ForceInit);
+
+	Hit.bBlockingHit = true;
+	Hit.TraceStart = Origin;
+	Hit.TraceEnd = Origin + Direction * TraceDistance;
+	Hit.Location = Hit.ImpactPoint = ImpactPoint;
+	Hit.Normal = Hit.ImpactNormal = -Direction;
+	Hit.Distance = FVector::Dist(Origin, ImpactPoint);
+	Hit.Time = TraceDistance > 0.f ? Hit.Distance / TraceDistance : 0.f;
+
+	if (HitPlayer)
+	{
+		Hit.HitObjectHandle = FActorInstanceHandle(HitPlayer);
+		Hit.Component = HitPlayer->GetMesh();
+
+		if (BoneIndex != INDEX_NONE && HitPlayer->GetMesh())
+		{
+			Hit.BoneName = HitPlayer->GetMesh()->GetBoneName(BoneIndex);
+		}
+	}
+
+	return Hit;
+}
+
 void AWeapon::HandleHit(const FHitResult& Hit, class ASurvivalCharacter* HitPlayer /*= nullptr*/)
 {
 	if (Hit.GetActor())
@@ -554,7 +661,16 @@ void AWeapon::HandleHit(const FHitResult& Hit, class ASurvivalCharacter* HitPlay
 		UE_LOG(LogTemp, Warning, TEXT("Hit actor %s"), *Hit.GetActor()->GetName());
 	}
 
-	ServerHandleHit(Hit, HitPlayer);
+	/**Clients send their hits along with the shots they came from, the server can apply them straight away. Only hits on 
+	players do anything on the server, so world hits aren't sent at all*/
+	if (HasAuthority())
+	{
+		ProcessShotReport(MakeShotReport(Hit, HitPlayer));
+	}
+	else if (HitPlayer)
+	{
+		PendingHitReports.Add(MakeShotReport(Hit, HitPlayer));
+	}
 
 	if (HitPlayer && PawnOwner)
 	{
@@ -565,32 +681,68 @@ void AWeapon::HandleHit(const FHitResult& Hit, class ASurvivalCharacter* HitPlay
 	}
 }
 
-void AWeapon::ServerHandleHit_Implementation(const FHitResult& Hit, class ASurvivalCharacter* HitPlayer /*= nullptr*/)
+FSurvivalShotReport AWeapon::MakeShotReport(const FHitResult& Hit, class ASurvivalCharacter* HitPlayer /*= nullptr*/) const
 {
-	if (PawnOwner)
+	FSurvivalShotReport ShotReport;
+
+	ShotReport.Origin = Hit.TraceStart;
+	ShotReport.Direction = (Hit.TraceEnd - Hit.TraceStart).GetSafeNormal();
+	ShotReport.ImpactPoint = Hit.ImpactPoint;
+	ShotReport.HitPlayer = HitPlayer;
+
+	if (HitPlayer && HitPlayer->GetMesh() && Hit.BoneName != NAME_None)
+	{
+		const int32 BoneIndex = HitPlayer->GetMesh()->GetBoneIndex(Hit.BoneName);
+		ShotReport.BoneIndex = BoneIndex <= MAX_int16 ? BoneIndex : INDEX_NONE;
+	}
+
+	ShotReport.ShotTime = CurrentShotTime;
+
+	return ShotReport;
+}
+
+void AWeapon::ProcessShotReport(const FSurvivalShotReport& ShotReport)
+{
+	//Only hits on players do anything on the server
+	if (!PawnOwner || !ShotReport.HitPlayer)
 	{
-		float DamageMultiplier = 1.f;
+		return;
+	}
 
-		/**Certain bones like head might give extra damage if hit. Apply those.*/
-		for (auto& BoneDamageModifier : HitScanConfig.BoneDamageModifiers)
-		{
-			if (Hit.BoneName == BoneDamageModifier.Key)
-			{
-				DamageMultiplier = BoneDamageModifier.Value;
-				break;
-			}
-		}
+	const FHitResult Hit = ShotReport.ToHitResult(HitScanConfig.Distance);
 
-		if (HitPlayer)
+	/**Check the hit against where the target was when the shot was fired rather than trusting it. Hits are checked in a batch
+	at the end of the frame, and if it holds up we go with the bone that was found instead of the one we were told*/
+	if (ULagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<ULagCompensationSubsystem>())
+	{
+		//The shot has to have come from about where we were, or the check below means nothing
+		if (!LagCompensation->IsShotOriginValid(PawnOwner, ShotReport.ShotTime, ShotReport.Origin))
 		{
-			UGameplayStatics::ApplyPointDamage(HitPlayer, HitScanConfig.Damage * DamageMultiplier, (Hit.TraceStart - Hit.TraceEnd).GetSafeNormal(), Hit, PawnOwner->GetController(), this, HitScanConfig.DamageType);
+			return;
 		}
+
+		LagCompensation->QueueHit(PawnOwner, ShotReport.HitPlayer, ShotReport.ShotTime, Hit.TraceStart, Hit.TraceEnd, 0.f, Hit.BoneName,
+			FOnLagCompensatedHitVerified::CreateUObject(this, &AWeapon::ApplyShotReport, ShotReport));
+	}
+	else
+	{
+		ApplyShotReport(true, Hit.BoneName, ShotReport);
 	}
 }
 
-bool AWeapon::ServerHandleHit_Validate(const FHitResult& Hit, class ASurvivalCharacter* HitPlayer /*= nullptr*/)
+void AWeapon::ApplyShotReport(const bool bValidHit, const FName BoneName, FSurvivalShotReport ShotReport)
 {
-	return true;
+	if (bValidHit && PawnOwner && IsValid(ShotReport.HitPlayer))
+	{
+		FHitResult Hit = ShotReport.ToHitResult(HitScanConfig.Distance);
+		Hit.BoneName = BoneName;
+
+		/**Certain bones like head might give extra damage if hit. Apply those.*/
+		const float* BoneDamageModifier = HitScanConfig.BoneDamageModifiers.Find(Hit.BoneName);
+		const float DamageMultiplier = BoneDamageModifier ? *BoneDamageModifier : 1.f;
+
+		UGameplayStatics::ApplyPointDamage(ShotReport.HitPlayer, HitScanConfig.Damage * DamageMultiplier, (Hit.TraceStart - Hit.TraceEnd).GetSafeNormal(), Hit, PawnOwner->GetController(), this, HitScanConfig.DamageType);
+	}
 }
 
 void AWeapon::FireShot()
@@ -660,11 +812,21 @@ void AWeapon::HandleFiring()
 
 		if (PawnOwner && PawnOwner->IsLocallyControlled())
 		{
+			const AGameStateBase* GameState = GetWorld()->GetGameState();
+			CurrentShotTime = GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+
 			FireShot();
 			UseClipAmmo();
 
 			// update firing FX on remote clients if function was called on server
 			BurstCounter++;
+			MARK_PROPERTY_DIRTY_FROM_NAME(AWeapon, BurstCounter, this);
+
+			// local client will notify server
+			if (!HasAuthority())
+			{
+				QueueShot(CurrentShotTime);
+			}
 		}
 	}
 	else if (CanReload())
@@ -688,12 +850,6 @@ void AWeapon::HandleFiring()
 
 	if (PawnOwner && PawnOwner->IsLocallyControlled())
 	{
-		// local client will notify server
-		if (HasAuthority())
-		{
-			ServerHandleFiring();
-		}
-
 		// reload after firing last round
 		if (CurrentAmmoInClip <= 0 && CanReload())
 		{
@@ -731,6 +887,7 @@ void AWeapon::OnBurstFinished()
 {
 	// stop firing FX on remote clients
 	BurstCounter = 0;
+	MARK_PROPERTY_DIRTY_FROM_NAME(AWeapon, BurstCounter, this);
 
 	// stop firing FX locally, unless it's a dedicated server
 	if (GetNetMode() != NM_DedicatedServer)
@@ -880,24 +1037,131 @@ FHitResult AWeapon::WeaponTrace(const FVector& StartTrace, const FVector& EndTra
 	return Hit;
 }
 
-void AWeapon::ServerHandleFiring_Implementation()
+void AWeapon::QueueShot(const float ShotTime)
 {
-	//GEngine->AddOnScreenDebugMessage(-1, 15.0f, FColor::Green, "ServerHandleFiring");
-	const bool bShouldUpdateAmmo = (CurrentAmmoInClip > 0 && CanFire());
+	PendingShotTimes.Add(ShotTime);
 
-	HandleFiring();
+	//Don't let a long batch window build up more shots than the server will take
+	if (PendingShotTimes.Num() >= MaxShotsPerBatch)
+	{
+		FlushShots();
+		return;
+	}
 
-	if (bShouldUpdateAmmo)
+	//Automatic weapons can fire more than once a frame, so rather than an RPC per shot the server gets them all at once
+	if (!GetWorldTimerManager().IsTimerActive(TimerHandle_FlushShots))
 	{
-		// update ammo
-		UseClipAmmo();
+		if (ShotBatchWindow > 0.f)
+		{
+			GetWorldTimerManager().SetTimer(TimerHandle_FlushShots, this, &AWeapon::FlushShots, ShotBatchWindow, false);
+		}
+		else
+		{
+			TimerHandle_FlushShots = GetWorldTimerManager().SetTimerForNextTick(this, &AWeapon::FlushShots);
+		}
+	}
+}
 
-		// update firing FX on remote clients
-		BurstCounter++;
+void AWeapon::FlushShots()
+{
+	GetWorldTimerManager().ClearTimer(TimerHandle_FlushShots);
+
+	if (PendingShotTimes.Num())
+	{
+		ServerFireShots(PendingShotTimes, PendingHitReports);
 	}
+
+	PendingShotTimes.Reset();
+	PendingHitReports.Reset();
 }
 
-bool AWeapon::ServerHandleFiring_Validate()
+void AWeapon::ServerFireShots_Implementation(const TArray<float>& ShotTimes, const TArray<FSurvivalShotReport>& HitReports)
 {
+	int32 HitIndex = 0;
+	bool bRefusedShot = false;
+
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+	const float ServerTime = GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+
+	const ULagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<ULagCompensationSubsystem>();
+	const float MaxRewindTime = LagCompensation ? LagCompensation->MaxRewindTime : 0.5f;
+
+	//Top the budget up by however many shots the weapon could have fired since we last looked, going by our clock not theirs
+	const float TimeBetweenShots = FMath::Max(WeaponConfig.TimeBetweenShots, KINDA_SMALL_NUMBER);
+	const float MaxShotBudget = 1.f + (ShotBatchWindow + ShotSpacingTolerance) / TimeBetweenShots;
+
+	ShotBudget = FMath::Min(ShotBudget + FMath::Max(ServerTime - ShotBudgetTime, 0.f) / TimeBetweenShots, MaxShotBudget);
+	ShotBudgetTime = ServerTime;
+
+	for (const float ShotTime : ShotTimes)
+	{
+		//Shots can't come faster than the weapon fires, from the future, or from further back than we can rewind to
+		const bool bShotAllowed = ShotBudget >= 1.f && ShotTime <= ServerTime + ShotSpacingTolerance && ShotTime >= ServerTime - MaxRewindTime;
+		const bool bShouldUpdateAmmo = bShotAllowed && (CurrentAmmoInClip > 0 && CanFire());
+
+		if (bShotAllowed)
+		{
+			HandleFiring();
+		}
+
+		if (bShouldUpdateAmmo)
+		{
+			// update ammo
+			UseClipAmmo();
+
+			// update firing FX on remote clients
+			BurstCounter++;
+			MARK_PROPERTY_DIRTY_FROM_NAME(AWeapon, BurstCounter, this);
+
+			ShotBudget -= 1.f;
+		}
+		else
+		{
+			bRefusedShot = true;
+		}
+
+		//Apply what this shot hit before moving on to the next one. Hits from shots we refused are dropped
+		while (HitReports.IsValidIndex(HitIndex) && HitReports[HitIndex].ShotTime <= ShotTime)
+		{
+			if (bShouldUpdateAmmo)
+			{
+				ProcessShotReport(HitReports[HitIndex]);
+			}
+
+			++HitIndex;
+		}
+	}
+
+	//The client already took the ammo for the shots we refused, and as our count didn't change replication won't correct it
+	if (bRefusedShot)
+	{
+		ClientSetAmmoInClip(CurrentAmmoInClip);
+	}
+}
+
+bool AWeapon::ServerFireShots_Validate(const TArray<float>& ShotTimes, const TArray<FSurvivalShotReport>& HitReports)
+{
+	//Nobody can legitimately fire this many shots in one batch, or hit more things than they fired at
+	if (ShotTimes.Num() > MaxShotsPerBatch || HitReports.Num() > ShotTimes.Num())
+	{
+		return false;
+	}
+
+	for (const float ShotTime : ShotTimes)
+	{
+		if (!FMath::IsFinite(ShotTime))
+		{
+			return false;
+		}
+	}
+
+	for (const FSurvivalShotReport& HitReport : HitReports)
+	{
+		if (!FMath::IsFinite(HitReport.ShotTime) || HitReport.BoneIndex < INDEX_NONE)
+		{
+			return false;
+		}
+	}
+
 	return true;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Engine/NetSerialization.h"
 #include "Weapon.generated.h"
 
 class UAnimMontage;
@@ -98,6 +99,60 @@ struct FHitScanConfiguration
 
 };
 
+/**What a client tells the server about a shot that hit something. A full FHitResult is dozens of bytes of vectors, names and flags
+the server never looks at, so this only sends the quantized shot, where it landed and which bone it hit. The server rebuilds a hit
+result from it with ToHitResult.*/
+USTRUCT()
+struct FSurvivalShotReport
+{
+	GENERATED_BODY()
+
+	FSurvivalShotReport()
+	{
+		HitPlayer = nullptr;
+		BoneIndex = INDEX_NONE;
+		ShotTime = 0.f;
+	}
+
+	//Where the shot was traced from, to a tenth of a cm
+	UPROPERTY()
+		FVector_NetQuantize10 Origin;
+
+	//Which way the shot went
+	UPROPERTY()
+		FVector_NetQuantizeNormal Direction;
+
+	//Where the shot landed, to the nearest cm
+	UPROPERTY()
+		FVector_NetQuantize ImpactPoint;
+
+	//The player that was hit, if any
+	UPROPERTY()
+		class ASurvivalCharacter* HitPlayer;
+
+	//Index of the bone we hit in the hit player's mesh, instead of sending the bone name
+	UPROPERTY()
+		int16 BoneIndex;
+
+	//Server world time when the shot was fired
+	UPROPERTY()
+		float ShotTime;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	//Rebuild a hit result good enough to apply damage with
+	FHitResult ToHitResult(const float TraceDistance) const;
+};
+
+template<>
+struct TStructOpsTypeTraits<FSurvivalShotReport> : public TStructOpsTypeTraitsBase2<FSurvivalShotReport>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
 UCLASS()
 class SURVIVALGAME_API AWeapon : public AActor
 {
@@ -163,6 +218,10 @@ protected:
 	UFUNCTION(reliable, client)
 		void ClientStartReload();
 
+	/** [server] Put the owning clients clip back in line with ours after we refused some of its shots */
+	UFUNCTION(reliable, client)
+		void ClientSetAmmoInClip(const int32 AmmoInClip);
+
 	bool CanFire() const;
 	bool CanReload() const;
 
@@ -231,6 +290,18 @@ protected:
 	UPROPERTY(Config)
 		bool bAllowAutomaticWeaponCatchup = true;
 
+	/** How long to collect shots for before sending them to the server together. Zero sends them at the end of the frame */
+	UPROPERTY(EditDefaultsOnly, Category = Config)
+		float ShotBatchWindow;
+
+	/** How much firing time the server lets a client get ahead by, on top of a batch window and a shot. Covers frame hitches,
+	automatic weapon catchup and network jitter */
+	UPROPERTY(EditDefaultsOnly, Category = Config)
+		float ShotSpacingTolerance;
+
+	/** Most shots that go up to the server in one batch. A full batch is sent straight away, the server rejects anything bigger */
+	static constexpr int32 MaxShotsPerBatch = 64;
+
 	/** firing audio (bLoopedFireSound set) */
 	UPROPERTY(Transient)
 		UAudioComponent* FireAC;
@@ -387,6 +458,21 @@ protected:
 	/** Handle for efficient management of HandleFiring timer */
 	FTimerHandle TimerHandle_HandleFiring;
 
+	/** Handle for sending the queued shots */
+	FTimerHandle TimerHandle_FlushShots;
+
+	/** Server world time of the shot currently being fired */
+	float CurrentShotTime;
+
+	/** Shots fired since we last told the server, and what they hit */
+	TArray<float> PendingShotTimes;
+	TArray<FSurvivalShotReport> PendingHitReports;
+
+	/** [server] How many shots the client can fire right now, and the server time it was worked out at. It fills up at the
+	weapons fire rate to at most a batch worth of shots, so shots can't come faster than the weapon fires however they're timestamped */
+	float ShotBudget;
+	float ShotBudgetTime;
+
 	//////////////////////////////////////////////////////////////////////////
 // Input - server side
 
@@ -426,15 +512,27 @@ protected:
 	/**Handle hit locally before asking server to process hit*/
 	void HandleHit(const FHitResult& Hit, class ASurvivalCharacter* HitPlayer = nullptr);
 
-	UFUNCTION(Server, Reliable, WithValidation)
-		void ServerHandleHit(const FHitResult& Hit, class ASurvivalCharacter* HitPlayer = nullptr);
+	/**Squash a local hit down to what the server needs to know about it*/
+	FSurvivalShotReport MakeShotReport(const FHitResult& Hit, class ASurvivalCharacter* HitPlayer = nullptr) const;
+
+	/** [server] check a shot that hit something, and apply its damage once it's been checked */
+	void ProcessShotReport(const FSurvivalShotReport& ShotReport);
+
+	/** [server] apply damage for a shot once lag compensation has had its say */
+	void ApplyShotReport(const bool bValidHit, const FName BoneName, FSurvivalShotReport ShotReport);
 
 	/** [local] weapon specific fire implementation */
 	virtual void FireShot();
 
-	/** [server] fire & update ammo */
+	/** [local] remember a shot so it goes up with the rest of this frame's shots */
+	void QueueShot(const float ShotTime);
+
+	/** [local] send every queued shot to the server in one go */
+	void FlushShots();
+
+	/** [server] fire & update ammo for each shot in order, applying the hits as we go. Hits are matched to shots by time */
 	UFUNCTION(reliable, server, WithValidation)
-		void ServerHandleFiring();
+		void ServerFireShots(const TArray<float>& ShotTimes, const TArray<FSurvivalShotReport>& HitReports);
 
 	/** [local + server] handle weapon refire, compensating for slack time if the timer can't sample fast enough */
 	void HandleReFiring();
@@ -0,0 +1,141 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurvivalGame/World/InteractionSubsystem.h"
+#include "SurvivalGame/Components/InteractionComponent.h"
+
+UInteractionSubsystem::UInteractionSubsystem()
+{
+	CellSize = 1000.f;
+	FocusConeAngle = 15.f;
+	InteractionRangeTolerance = 100.f;
+	MaxInteractionDistance = 0.f;
+}
+
+void UInteractionSubsystem::Deinitialize()
+{
+	Cells.Empty();
+	InteractableCells.Empty();
+
+	Super::Deinitialize();
+}
+
+FIntVector UInteractionSubsystem::GetCell(const FVector& Location) const
+{
+	return FIntVector(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize), FMath::FloorToInt(Location.Z / CellSize));
+}
+
+void UInteractionSubsystem::RegisterInteractable(UInteractionComponent* Interactable)
+{
+	if (!Interactable || InteractableCells.Contains(Interactable))
+	{
+		return;
+	}
+
+	const FIntVector Cell = GetCell(Interactable->GetComponentLocation());
+
+	Cells.FindOrAdd(Cell).Add(Interactable);
+	InteractableCells.Add(Interactable, Cell);
+
+	MaxInteractionDistance = FMath::Max(MaxInteractionDistance, Interactable->InteractionDistance);
+}
+
+void UInteractionSubsystem::UnregisterInteractable(UInteractionComponent* Interactable)
+{
+	FIntVector Cell;
+
+	if (InteractableCells.RemoveAndCopyValue(Interactable, Cell))
+	{
+		if (TArray<UInteractionComponent*>* CellInteractables = Cells.Find(Cell))
+		{
+			CellInteractables->RemoveSingleSwap(Interactable);
+
+			if (!CellInteractables->Num())
+			{
+				Cells.Remove(Cell);
+			}
+		}
+	}
+}
+
+void UInteractionSubsystem::UpdateInteractable(UInteractionComponent* Interactable)
+{
+	const FIntVector* Cell = InteractableCells.Find(Interactable);
+
+	if (Cell && *Cell != GetCell(Interactable->GetComponentLocation()))
+	{
+		UnregisterInteractable(Interactable);
+		RegisterInteractable(Interactable);
+	}
+}
+
+UInteractionComponent* UInteractionSubsystem::FindInteractable(const FVector& ViewLocation, const FVector& ViewDirection, const float MaxDistance, const AActor* IgnoreActor) const
+{
+	const float SearchDistance = FMath::Min(MaxDistance, MaxInteractionDistance);
+
+	if (SearchDistance <= 0.f)
+	{
+		return nullptr;
+	}
+
+	const FIntVector MinCell = GetCell(ViewLocation - FVector(SearchDistance));
+	const FIntVector MaxCell = GetCell(ViewLocation + FVector(SearchDistance));
+	const float MinDot = FMath::Cos(FMath::DegreesToRadians(FocusConeAngle));
+
+	UInteractionComponent* BestInteractable = nullptr;
+	float BestDot = MinDot;
+
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				const TArray<UInteractionComponent*>* CellInteractables = Cells.Find(FIntVector(X, Y, Z));
+
+				if (!CellInteractables)
+				{
+					continue;
+				}
+
+				for (UInteractionComponent* Interactable : *CellInteractables)
+				{
+					if (Interactable->GetOwner() == IgnoreActor)
+					{
+						continue;
+					}
+
+					const FVector ToInteractable = Interactable->GetComponentLocation() - ViewLocation;
+					const float DistanceSq = ToInteractable.SizeSquared();
+
+					if (DistanceSq > FMath::Square(FMath::Min(Interactable->InteractionDistance, MaxDistance)))
+					{
+						continue;
+					}
+
+					//Standing right on top of something counts as looking at it
+					const float Dot = DistanceSq > KINDA_SMALL_NUMBER ? (ViewDirection | ToInteractable) * FMath::InvSqrt(DistanceSq) : 1.f;
+
+					if (Dot >= BestDot)
+					{
+						BestDot = Dot;
+						BestInteractable = Interactable;
+					}
+				}
+			}
+		}
+	}
+
+	return BestInteractable;
+}
+
+bool UInteractionSubsystem::IsInInteractionRange(const FVector& ViewLocation, const UInteractionComponent* Interactable) const
+{
+	if (!Interactable || !InteractableCells.Contains(Interactable))
+	{
+		return false;
+	}
+
+	const float Range = Interactable->InteractionDistance + InteractionRangeTolerance;
+	return FVector::DistSquared(ViewLocation, Interactable->GetComponentLocation()) <= Range * Range;
+}
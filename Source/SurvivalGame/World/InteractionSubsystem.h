@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "InteractionSubsystem.generated.h"
+
+class UInteractionComponent;
+
+/**
+ * Keeps every active interaction component in a spatial hash, so working out what a player could be looking at only has to
+ * consider what's nearby instead of tracing into the world and searching the actor that got hit.
+ */
+UCLASS(Config = Game)
+class SURVIVALGAME_API UInteractionSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	UInteractionSubsystem();
+
+	virtual void Deinitialize() override;
+
+	//Start or stop tracking an interactable. Components do this themselves as they're activated, deactivated and destroyed
+	void RegisterInteractable(UInteractionComponent* Interactable);
+	void UnregisterInteractable(UInteractionComponent* Interactable);
+
+	//Move an interactable to the right cell if it has moved out of the one it was in
+	void UpdateInteractable(UInteractionComponent* Interactable);
+
+	/**Find the interactable closest to the middle of the view that's in its own interaction distance and within FocusConeAngle
+	of the view direction. This doesn't check whether anything is in the way, that's for the caller to trace for*/
+	UInteractionComponent* FindInteractable(const FVector& ViewLocation, const FVector& ViewDirection, const float MaxDistance, const AActor* IgnoreActor) const;
+
+	/**[Server] Whether a player at ViewLocation could be interacting with this. Only looks up the interactable and checks the
+	distance, allowing for InteractionRangeTolerance*/
+	bool IsInInteractionRange(const FVector& ViewLocation, const UInteractionComponent* Interactable) const;
+
+	//Size of the cells interactables are hashed into
+	UPROPERTY(Config)
+	float CellSize;
+
+	//How far off the view direction, in degrees, an interactable can be and still get focused
+	UPROPERTY(Config)
+	float FocusConeAngle;
+
+	//Extra distance the server allows when checking a player can reach what they're interacting with, as the client is ahead of it
+	UPROPERTY(Config)
+	float InteractionRangeTolerance;
+
+private:
+
+	FIntVector GetCell(const FVector& Location) const;
+
+	/**Cell -> interactables in it. Components always unregister before they're destroyed, so these don't need to keep them
+	alive*/
+	TMap<FIntVector, TArray<UInteractionComponent*>> Cells;
+	TMap<const UInteractionComponent*, FIntVector> InteractableCells;
+
+	//The largest interaction distance of anything that's been registered, so queries know how far out to look
+	float MaxInteractionDistance;
+
+};
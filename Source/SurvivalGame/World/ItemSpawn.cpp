@@ -2,8 +2,7 @@
 
 
 #include "ItemSpawn.h"
-#include "SurvivalGame/World/Pickup.h"
-#include "SurvivalGame/Items/Item.h"
+#include "SurvivalGame/World/ItemSpawnSubsystem.h"
 
 AItemSpawn::AItemSpawn()
 {
@@ -11,76 +10,35 @@ AItemSpawn::AItemSpawn()
 	bNetLoadOnClient = false;
 
 	RespawnRange = FIntPoint(10, 30);
+
+	LootField = nullptr;
+	SpawnIndex = INDEX_NONE;
 }
 
 void AItemSpawn::BeginPlay()
 {
 	Super::BeginPlay();
 
-	if (HasAuthority())
-	{
-		SpawnItem();
-	}
-}
-
-void AItemSpawn::SpawnItem()
-{
-	if (HasAuthority() && LootTable)
+	//Spawns in the level were gathered when it started, this picks up ones in levels streamed in afterwards
+	if (HasAuthority() && SpawnIndex == INDEX_NONE)
 	{
-		TArray<FLootTableRow*> SpawnItems;
-		LootTable->GetAllRows("", SpawnItems);
-
-		const FLootTableRow* LootRow = SpawnItems[FMath::RandRange(0, SpawnItems.Num() - 1)];
-
-		ensure(LootRow);
-
-		float ProbabilityRoll = FMath::FRandRange(0.f, 1.f);
-
-		while (ProbabilityRoll > LootRow->Probability)
-		{
-			LootRow = SpawnItems[FMath::RandRange(0, SpawnItems.Num() - 1)];
-			ProbabilityRoll = FMath::FRandRange(0.f, 1.f);
-		}
-
-		if (LootRow && LootRow->Items.Num() && PickupClass)
+		if (UItemSpawnSubsystem* ItemSpawnSubsystem = GetWorld()->GetSubsystem<UItemSpawnSubsystem>())
 		{
-			float Angle = 0.f;
-
-			for (auto& ItemClass : LootRow->Items)
-			{
-				const FVector LocationOffset = FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f) * 50.f;
-
-				FActorSpawnParameters SpawnParams;
-				SpawnParams.bNoFail = true;
-				SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
-
-				const int32 ItemQuantity = ItemClass->GetDefaultObject<UItem>()->GetQuantity();
-
-				FTransform SpawnTransform = GetActorTransform();
-				SpawnTransform.AddToTranslation(LocationOffset);
-
-				APickup* Pickup = GetWorld()->SpawnActor<APickup>(PickupClass, SpawnTransform, SpawnParams);
-				Pickup->InitializePickup(ItemClass, ItemQuantity);
-				Pickup->OnDestroyed.AddUniqueDynamic(this, &AItemSpawn::OnItemTaken);
-
-				SpawnedPickups.Add(Pickup);
-
-				Angle += (PI * 2.f) / LootRow->Items.Num();
-			}
+			ItemSpawnSubsystem->RegisterSpawn(this);
 		}
 	}
 }
 
-void AItemSpawn::OnItemTaken(AActor* DestroyedActor)
+void AItemSpawn::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	if (HasAuthority())
-	{
-		SpawnedPickups.Remove(DestroyedActor);
+	Super::EndPlay(EndPlayReason);
 
-		//If all pickups were taken queue a respawn
-		if (SpawnedPickups.Num() <= 0)
+	//Let the subsystem know we're gone, so it doesn't spawn for us until our level streams back in
+	if (HasAuthority() && SpawnIndex != INDEX_NONE)
+	{
+		if (UItemSpawnSubsystem* ItemSpawnSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UItemSpawnSubsystem>() : nullptr)
 		{
-			GetWorldTimerManager().SetTimer(TimerHandle_RespawnItem, this, &AItemSpawn::SpawnItem, FMath::RandRange(RespawnRange.GetMin(), RespawnRange.GetMax()), false);
+			ItemSpawnSubsystem->UnregisterSpawn(this);
 		}
 	}
 }
@@ -25,7 +25,8 @@ public:
 };
 
 /**
- * 
+ * Somewhere loot spawns. This only holds settings; the item spawn subsystem reads every spawn point into its own table when the
+ * level starts, and does the spawning and respawning for all of them.
  */
 UCLASS()
 class SURVIVALGAME_API AItemSpawn : public ATargetPoint
@@ -48,19 +49,15 @@ public:
 	UPROPERTY(EditDefaultsOnly, Category = "Loot")
 	FIntPoint RespawnRange;
 
-protected:
+	/**If set, loot is put in this field instead of being spawned as pickup actors*/
+	UPROPERTY(EditAnywhere, Category = "Loot")
+	class ALootField* LootField;
 
-	FTimerHandle TimerHandle_RespawnItem;
+	//[Server] Where this spawn is in the item spawn subsystem's table, once it's been added
+	int32 SpawnIndex;
 
-	UPROPERTY()
-	TArray<AActor*> SpawnedPickups;
+protected:
 
 	virtual void BeginPlay() override;
-
-	UFUNCTION()
-	void SpawnItem();
-
-	//This is bound to the item being destroyed, so we can queue up another item to be spawned in
-	UFUNCTION()
-	void OnItemTaken(AActor* DestroyedActor);
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 };
@@ -0,0 +1,265 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurvivalGame/World/ItemSpawnSubsystem.h"
+#include "SurvivalGame/World/ItemSpawn.h"
+#include "SurvivalGame/World/LootField.h"
+#include "SurvivalGame/World/LootTableSampler.h"
+#include "SurvivalGame/World/Pickup.h"
+#include "SurvivalGame/Items/Item.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+
+UItemSpawnSubsystem::UItemSpawnSubsystem()
+{
+	MaxSpawnsPerTick = 8;
+	WheelSlots = 64;
+	SlotDuration = 1.f;
+
+	bGatheredSpawns = false;
+	PendingSpawnsHead = 0;
+	CurrentSlot = 0;
+	TimeInSlot = 0.f;
+}
+
+void UItemSpawnSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	//Both come from config. A slot of no time would spin the wheel forever in Tick
+	WheelSlots = FMath::Max(WheelSlots, 1);
+	SlotDuration = FMath::Max(SlotDuration, 0.05f);
+
+	Wheel.SetNum(WheelSlots);
+}
+
+void UItemSpawnSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	if (InWorld.GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	for (TActorIterator<AItemSpawn> It(&InWorld); It; ++It)
+	{
+		RegisterSpawn(*It);
+	}
+
+	bGatheredSpawns = true;
+}
+
+TStatId UItemSpawnSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UItemSpawnSubsystem, STATGROUP_Tickables);
+}
+
+int32 UItemSpawnSubsystem::RegisterSpawn(AItemSpawn* ItemSpawn)
+{
+	if (!ItemSpawn || ItemSpawn->SpawnIndex != INDEX_NONE)
+	{
+		return ItemSpawn ? ItemSpawn->SpawnIndex : INDEX_NONE;
+	}
+
+	const FSoftObjectPath SpawnPath(ItemSpawn);
+
+	if (const int32* ExistingRow = SpawnRows.Find(SpawnPath))
+	{
+		//Back from being streamed out. Its settings are read again since the level's actors are new objects now
+		const int32 SpawnIndex = *ExistingRow;
+
+		ItemSpawn->SpawnIndex = SpawnIndex;
+		Transforms[SpawnIndex] = ItemSpawn->GetActorTransform();
+		LootTables[SpawnIndex] = ItemSpawn->LootTable;
+		PickupClasses[SpawnIndex] = ItemSpawn->PickupClass;
+		LootFields[SpawnIndex] = ItemSpawn->LootField;
+		RespawnRanges[SpawnIndex] = ItemSpawn->RespawnRange;
+		ActiveSpawns[SpawnIndex] = true;
+
+		if (DueWhileInactive[SpawnIndex])
+		{
+			DueWhileInactive[SpawnIndex] = false;
+			PendingSpawns.Add(SpawnIndex);
+		}
+
+		return SpawnIndex;
+	}
+
+	ItemSpawn->SpawnIndex = Transforms.Add(ItemSpawn->GetActorTransform());
+	LootTables.Add(ItemSpawn->LootTable);
+	PickupClasses.Add(ItemSpawn->PickupClass);
+	LootFields.Add(ItemSpawn->LootField);
+	RespawnRanges.Add(ItemSpawn->RespawnRange);
+	NumSpawned.Add(0);
+	ActiveSpawns.Add(true);
+	DueWhileInactive.Add(false);
+
+	SpawnRows.Add(SpawnPath, ItemSpawn->SpawnIndex);
+	PendingSpawns.Add(ItemSpawn->SpawnIndex);
+
+	return ItemSpawn->SpawnIndex;
+}
+
+void UItemSpawnSubsystem::UnregisterSpawn(AItemSpawn* ItemSpawn)
+{
+	if (!ItemSpawn || !ActiveSpawns.IsValidIndex(ItemSpawn->SpawnIndex))
+	{
+		return;
+	}
+
+	ActiveSpawns[ItemSpawn->SpawnIndex] = false;
+	ItemSpawn->SpawnIndex = INDEX_NONE;
+}
+
+void UItemSpawnSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (!bGatheredSpawns)
+	{
+		return;
+	}
+
+	TimeInSlot += DeltaTime;
+
+	while (TimeInSlot >= SlotDuration)
+	{
+		TimeInSlot -= SlotDuration;
+		AdvanceWheel();
+	}
+
+	const int32 NumToSpawn = FMath::Min(PendingSpawns.Num() - PendingSpawnsHead, MaxSpawnsPerTick);
+
+	for (int32 i = 0; i < NumToSpawn; ++i)
+	{
+		SpawnLoot(PendingSpawns[PendingSpawnsHead++]);
+	}
+
+	//Once the queue has been worked through, start it again from the front instead of letting it grow
+	if (PendingSpawnsHead >= PendingSpawns.Num())
+	{
+		PendingSpawns.Reset();
+		PendingSpawnsHead = 0;
+	}
+}
+
+void UItemSpawnSubsystem::AdvanceWheel()
+{
+	CurrentSlot = (CurrentSlot + 1) % Wheel.Num();
+
+	TArray<FItemSpawnRespawn>& Slot = Wheel[CurrentSlot];
+
+	for (int32 i = Slot.Num() - 1; i >= 0; --i)
+	{
+		if (Slot[i].Rounds > 0)
+		{
+			--Slot[i].Rounds;
+		}
+		else
+		{
+			PendingSpawns.Add(Slot[i].SpawnIndex);
+			Slot.RemoveAtSwap(i, 1, false);
+		}
+	}
+}
+
+void UItemSpawnSubsystem::ScheduleRespawn(const int32 SpawnIndex)
+{
+	const float Delay = FMath::RandRange(RespawnRanges[SpawnIndex].GetMin(), RespawnRanges[SpawnIndex].GetMax());
+	const int32 Ticks = FMath::Max(FMath::CeilToInt(Delay / SlotDuration), 1);
+
+	FItemSpawnRespawn Respawn;
+	Respawn.SpawnIndex = SpawnIndex;
+	Respawn.Rounds = (Ticks - 1) / Wheel.Num();
+
+	Wheel[(CurrentSlot + Ticks) % Wheel.Num()].Add(Respawn);
+}
+
+void UItemSpawnSubsystem::OnLootTaken(const int32 SpawnIndex)
+{
+	if (!NumSpawned.IsValidIndex(SpawnIndex))
+	{
+		return;
+	}
+
+	//If all pickups were taken queue a respawn
+	if (--NumSpawned[SpawnIndex] <= 0)
+	{
+		NumSpawned[SpawnIndex] = 0;
+		ScheduleRespawn(SpawnIndex);
+	}
+}
+
+void UItemSpawnSubsystem::SpawnLoot(const int32 SpawnIndex)
+{
+	//Its level isn't loaded, so wait for it to come back instead of spawning loot where there might not be any floor
+	if (!ActiveSpawns[SpawnIndex])
+	{
+		DueWhileInactive[SpawnIndex] = true;
+		return;
+	}
+
+	const UDataTable* LootTable = LootTables[SpawnIndex];
+	ALootField* LootField = LootFields[SpawnIndex];
+	const TSubclassOf<APickup> PickupClass = PickupClasses[SpawnIndex];
+
+	if (!LootTable || (!LootField && !PickupClass))
+	{
+		return;
+	}
+
+	const FLootTableSampler* LootSampler = FLootTableSampler::Get(LootTable);
+	const FLootTableRow* LootRow = LootSampler ? LootSampler->PickRow() : nullptr;
+
+	ensure(LootRow);
+
+	//Nothing will be taken to trigger a respawn if nothing spawns, so try again later
+	if (!LootRow || !LootRow->Items.Num())
+	{
+		ScheduleRespawn(SpawnIndex);
+		return;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.bNoFail = true;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+	float Angle = 0.f;
+
+	for (auto& ItemClass : LootRow->Items)
+	{
+		const FVector LocationOffset = FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f) * 50.f;
+		Angle += (PI * 2.f) / LootRow->Items.Num();
+
+		if (!ItemClass)
+		{
+			continue;
+		}
+
+		const int32 ItemQuantity = ItemClass->GetDefaultObject<UItem>()->GetQuantity();
+
+		FTransform SpawnTransform = Transforms[SpawnIndex];
+		SpawnTransform.AddToTranslation(LocationOffset);
+
+		if (LootField)
+		{
+			if (LootField->AddLoot(ItemClass, ItemQuantity, SpawnTransform, SpawnIndex) != INDEX_NONE)
+			{
+				++NumSpawned[SpawnIndex];
+			}
+		}
+		else if (APickup* Pickup = GetWorld()->SpawnActor<APickup>(PickupClass, SpawnTransform, SpawnParams))
+		{
+			Pickup->InitializePickup(ItemClass, ItemQuantity);
+			Pickup->SpawnIndex = SpawnIndex;
+			++NumSpawned[SpawnIndex];
+		}
+	}
+
+	//The row's items were all empty or the loot field is full
+	if (NumSpawned[SpawnIndex] <= 0)
+	{
+		ScheduleRespawn(SpawnIndex);
+	}
+}
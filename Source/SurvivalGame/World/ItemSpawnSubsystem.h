@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/SoftObjectPath.h"
+#include "ItemSpawnSubsystem.generated.h"
+
+//A spawn point waiting on the timing wheel
+struct FItemSpawnRespawn
+{
+	int32 SpawnIndex = INDEX_NONE;
+
+	//How many more times the wheel has to come round to this slot before it's due
+	int32 Rounds = 0;
+};
+
+/**
+ * [Server] Runs every item spawn in the world. Spawn points are gathered into one table when the level starts, and from then on
+ * the spawn actors are only data. Respawns wait on a single timing wheel instead of a timer each, and spawning is spread over
+ * frames, at most MaxSpawnsPerTick a frame, so a level full of spawn points doesn't cost a hitch when it starts or everything
+ * respawns at once.
+ */
+UCLASS(Config = Game)
+class SURVIVALGAME_API UItemSpawnSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	UItemSpawnSubsystem();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/**Add a spawn point to the table and queue its first spawn. Every spawn in the level is added at begin play, spawns in
+	levels streamed in later add themselves. A spawn point coming back with its level gets its old row back rather than a new
+	one. Returns the spawn's index, which is what its loot carries around*/
+	int32 RegisterSpawn(class AItemSpawn* ItemSpawn);
+
+	/**Called when a spawn point leaves play, ie its level streamed out. Its row is kept so loot it already spawned still counts
+	against it, but it won't spawn anything until it's registered again*/
+	void UnregisterSpawn(class AItemSpawn* ItemSpawn);
+
+	//Called when some loot from a spawn point is taken. Once it's all gone the spawn point is put on the wheel to respawn
+	void OnLootTaken(const int32 SpawnIndex);
+
+	//Most spawn points spawned per frame
+	UPROPERTY(Config)
+	int32 MaxSpawnsPerTick;
+
+	//How many slots the timing wheel has, and how long each slot is in seconds. Respawns longer than a turn of the wheel just wait extra turns
+	UPROPERTY(Config)
+	int32 WheelSlots;
+
+	UPROPERTY(Config)
+	float SlotDuration;
+
+private:
+
+	void SpawnLoot(const int32 SpawnIndex);
+
+	//Put a spawn point on the wheel to spawn again after a random time in its respawn range
+	void ScheduleRespawn(const int32 SpawnIndex);
+
+	//Move the wheel on a slot, queueing everything that's now due
+	void AdvanceWheel();
+
+	bool bGatheredSpawns;
+
+	//The spawn table, one entry per spawn point in each array
+	TArray<FTransform> Transforms;
+
+	UPROPERTY()
+	TArray<class UDataTable*> LootTables;
+
+	UPROPERTY()
+	TArray<TSubclassOf<class APickup>> PickupClasses;
+
+	UPROPERTY()
+	TArray<class ALootField*> LootFields;
+
+	TArray<FIntPoint> RespawnRanges;
+
+	//How much of each spawn point's loot is still lying around
+	TArray<int32> NumSpawned;
+
+	//Rows by spawn point, so one that streams out and back in finds its row again
+	TMap<FSoftObjectPath, int32> SpawnRows;
+
+	//Rows whose spawn point is in play, and rows that came due while their spawn point wasn't, to be spawned when it's back
+	TBitArray<> ActiveSpawns;
+	TBitArray<> DueWhileInactive;
+
+	//Spawn points due to spawn, oldest first. Entries before PendingSpawnsHead have already been spawned
+	TArray<int32> PendingSpawns;
+	int32 PendingSpawnsHead;
+
+	TArray<TArray<FItemSpawnRespawn>> Wheel;
+	int32 CurrentSlot;
+	float TimeInSlot;
+
+};
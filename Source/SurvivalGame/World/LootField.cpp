@@ -0,0 +1,392 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurvivalGame/World/LootField.h"
+#include "SurvivalGame/World/Pickup.h"
+#include "SurvivalGame/World/ItemSpawnSubsystem.h"
+#include "SurvivalGame/Items/Item.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/Pawn.h"
+#include "Net/UnrealNetwork.h"
+#include "Engine/World.h"
+
+FTransform FLootFieldRecord::GetTransform() const
+{
+	return FTransform(FRotator(0.f, FRotator::DecompressAxisFromShort(Yaw), 0.f), Location);
+}
+
+void FLootFieldRecord::PreReplicatedRemove(const FLootFieldRecordList& InArraySerializer)
+{
+	if (InArraySerializer.OwnerField)
+	{
+		InArraySerializer.OwnerField->HideInstance(*this);
+	}
+}
+
+void FLootFieldRecord::PostReplicatedAdd(const FLootFieldRecordList& InArraySerializer)
+{
+	if (InArraySerializer.OwnerField)
+	{
+		InArraySerializer.OwnerField->RefreshInstance(*this);
+	}
+}
+
+void FLootFieldRecord::PostReplicatedChange(const FLootFieldRecordList& InArraySerializer)
+{
+	if (InArraySerializer.OwnerField)
+	{
+		InArraySerializer.OwnerField->RefreshInstance(*this);
+	}
+}
+
+bool FLootFieldRecordList::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	return FFastArraySerializer::FastArrayDeltaSerialize<FLootFieldRecord, FLootFieldRecordList>(Records, DeltaParms, *this);
+}
+
+ALootField::ALootField()
+{
+	SetRootComponent(CreateDefaultSubobject<USceneComponent>("Root"));
+
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
+	SetReplicates(true);
+	bAlwaysRelevant = true;
+
+	Loot.OwnerField = this;
+
+	PromotionRadius = 600.f;
+	DemotionRadius = 900.f;
+	PromotionCheckInterval = 0.25f;
+	InstanceCullDistance = 10000.f;
+	TimeSincePromotionCheck = 0.f;
+}
+
+void ALootField::BeginPlay()
+{
+	Super::BeginPlay();
+
+	//Only the server looks for loot to promote, clients just draw what they're sent
+	SetActorTickEnabled(HasAuthority());
+}
+
+void ALootField::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ALootField, Loot);
+}
+
+FIntPoint ALootField::GetCell(const FVector& Location) const
+{
+	//Cells are at least as big as the promotion radius, so a player only ever needs to check the cells around them
+	const float CellSize = FMath::Max(PromotionRadius, 100.f);
+	return FIntPoint(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize));
+}
+
+int32 ALootField::AddLoot(const TSubclassOf<class UItem> ItemClass, const int32 Quantity, const FTransform& Transform, const int32 SpawnIndex /*= INDEX_NONE*/)
+{
+	if (!HasAuthority() || !ItemClass || Quantity <= 0)
+	{
+		return INDEX_NONE;
+	}
+
+	if (!ensureMsgf(FreeRecords.Num() || Loot.Records.Num() < MaxRecords, TEXT("%s is full, split its loot across more fields."), *GetName()))
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 RecordIndex = FreeRecords.Num() ? FreeRecords.Pop(false) : Loot.Records.AddDefaulted();
+
+	FLootFieldRecord& Record = Loot.Records[RecordIndex];
+	Record.Location = Transform.GetLocation();
+	Record.Yaw = FRotator::CompressAxisToShort(Transform.Rotator().Yaw);
+	Record.ItemClass = ItemClass;
+	Record.Quantity = Quantity;
+	Record.bPromoted = false;
+	Record.SpawnIndex = SpawnIndex;
+
+	Cells.FindOrAdd(GetCell(Record.Location)).Add(RecordIndex);
+
+	Loot.MarkItemDirty(Record);
+	RefreshInstance(Record);
+
+	return RecordIndex;
+}
+
+void ALootField::RemoveLoot(const int32 RecordIndex)
+{
+	if (!HasAuthority() || !Loot.Records.IsValidIndex(RecordIndex) || !Loot.Records[RecordIndex].IsInUse())
+	{
+		return;
+	}
+
+	FLootFieldRecord& Record = Loot.Records[RecordIndex];
+	const FIntPoint Cell = GetCell(Record.Location);
+
+	if (TArray<int32>* CellRecords = Cells.Find(Cell))
+	{
+		CellRecords->RemoveSingleSwap(RecordIndex);
+
+		if (!CellRecords->Num())
+		{
+			Cells.Remove(Cell);
+		}
+	}
+
+	const int32 SpawnIndex = Record.SpawnIndex;
+
+	Record.ItemClass = nullptr;
+	Record.Quantity = 0;
+	Record.bPromoted = false;
+	Record.SpawnIndex = INDEX_NONE;
+
+	Loot.MarkItemDirty(Record);
+	RefreshInstance(Record);
+
+	FreeRecords.Add(RecordIndex);
+
+	if (SpawnIndex != INDEX_NONE)
+	{
+		if (UItemSpawnSubsystem* ItemSpawnSubsystem = GetWorld()->GetSubsystem<UItemSpawnSubsystem>())
+		{
+			ItemSpawnSubsystem->OnLootTaken(SpawnIndex);
+		}
+	}
+}
+
+void ALootField::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	TimeSincePromotionCheck += DeltaTime;
+
+	if (TimeSincePromotionCheck >= PromotionCheckInterval)
+	{
+		TimeSincePromotionCheck = 0.f;
+		UpdatePromotions();
+	}
+}
+
+void ALootField::UpdatePromotions()
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_LootField_UpdatePromotions);
+
+	TArray<FVector, TInlineAllocator<64>> PlayerLocations;
+
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		if (const APawn* Pawn = It->Get() ? It->Get()->GetPawn() : nullptr)
+		{
+			PlayerLocations.Add(Pawn->GetActorLocation());
+		}
+	}
+
+	//Put pickups that nobody is near any more back in the field first, so their records can't be promoted again straight away
+	TArray<TPair<APickup*, int32>, TInlineAllocator<16>> ToDemote;
+
+	for (const auto& PromotedPickup : PromotedPickups)
+	{
+		const FVector PickupLocation = PromotedPickup.Key->GetActorLocation();
+		bool bPlayerNearby = false;
+
+		for (const FVector& PlayerLocation : PlayerLocations)
+		{
+			if (FVector::DistSquared(PlayerLocation, PickupLocation) <= DemotionRadius * DemotionRadius)
+			{
+				bPlayerNearby = true;
+				break;
+			}
+		}
+
+		if (!bPlayerNearby)
+		{
+			ToDemote.Emplace(PromotedPickup.Key, PromotedPickup.Value);
+		}
+	}
+
+	for (const TPair<APickup*, int32>& Demotion : ToDemote)
+	{
+		Demote(Demotion.Key, Demotion.Value);
+	}
+
+	TArray<int32, TInlineAllocator<16>> ToPromote;
+
+	for (const FVector& PlayerLocation : PlayerLocations)
+	{
+		const FIntPoint PlayerCell = GetCell(PlayerLocation);
+
+		for (int32 X = PlayerCell.X - 1; X <= PlayerCell.X + 1; ++X)
+		{
+			for (int32 Y = PlayerCell.Y - 1; Y <= PlayerCell.Y + 1; ++Y)
+			{
+				if (const TArray<int32>* CellRecords = Cells.Find(FIntPoint(X, Y)))
+				{
+					for (const int32 RecordIndex : *CellRecords)
+					{
+						const FLootFieldRecord& Record = Loot.Records[RecordIndex];
+
+						if (!Record.bPromoted && FVector::DistSquared(PlayerLocation, Record.Location) <= PromotionRadius * PromotionRadius)
+						{
+							ToPromote.AddUnique(RecordIndex);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for (const int32 RecordIndex : ToPromote)
+	{
+		Promote(RecordIndex);
+	}
+}
+
+void ALootField::Promote(const int32 RecordIndex)
+{
+	FLootFieldRecord& Record = Loot.Records[RecordIndex];
+
+	if (!PickupClass || !Record.IsInUse() || Record.bPromoted)
+	{
+		return;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.bNoFail = true;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	APickup* Pickup = GetWorld()->SpawnActor<APickup>(PickupClass, Record.GetTransform(), SpawnParams);
+
+	if (!Pickup)
+	{
+		return;
+	}
+
+	Pickup->InitializePickup(Record.ItemClass, Record.Quantity);
+	Pickup->OnDestroyed.AddUniqueDynamic(this, &ALootField::OnPromotedPickupDestroyed);
+
+	PromotedPickups.Add(Pickup, RecordIndex);
+
+	Record.bPromoted = true;
+	Loot.MarkItemDirty(Record);
+	RefreshInstance(Record);
+}
+
+void ALootField::Demote(APickup* Pickup, const int32 RecordIndex)
+{
+	PromotedPickups.Remove(Pickup);
+
+	if (!Pickup)
+	{
+		return;
+	}
+
+	//Stop listening first, this isn't the pickup being taken
+	Pickup->OnDestroyed.RemoveDynamic(this, &ALootField::OnPromotedPickupDestroyed);
+
+	FLootFieldRecord& Record = Loot.Records[RecordIndex];
+
+	//Players might have taken some of the stack while it was a pickup
+	if (const UItem* Item = Pickup->GetItem())
+	{
+		Record.Quantity = Item->GetQuantity();
+	}
+
+	Pickup->Destroy();
+
+	if (Record.Quantity <= 0)
+	{
+		RemoveLoot(RecordIndex);
+		return;
+	}
+
+	Record.bPromoted = false;
+	Loot.MarkItemDirty(Record);
+	RefreshInstance(Record);
+}
+
+void ALootField::OnPromotedPickupDestroyed(AActor* DestroyedActor)
+{
+	int32 RecordIndex = INDEX_NONE;
+
+	//The pickup only gets destroyed out from under us when someone takes it
+	if (PromotedPickups.RemoveAndCopyValue(Cast<APickup>(DestroyedActor), RecordIndex))
+	{
+		RemoveLoot(RecordIndex);
+	}
+}
+
+void ALootField::RefreshInstance(FLootFieldRecord& Record)
+{
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		return;
+	}
+
+	const UItem* ItemCDO = Record.ItemClass ? Record.ItemClass->GetDefaultObject<UItem>() : nullptr;
+	UStaticMesh* Mesh = ItemCDO && !Record.bPromoted ? ItemCDO->PickupMesh : nullptr;
+
+	//Hide what we were showing if it's gone, promoted, or a different mesh now
+	if (Record.InstanceMesh && Record.InstanceMesh != Mesh)
+	{
+		HideInstance(Record);
+	}
+
+	if (!Mesh)
+	{
+		return;
+	}
+
+	UInstancedStaticMeshComponent*& Instances = MeshInstances.FindOrAdd(Mesh);
+
+	if (!Instances)
+	{
+		Instances = NewObject<UInstancedStaticMeshComponent>(this);
+		Instances->SetStaticMesh(Mesh);
+		Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		Instances->SetCullDistances(0, InstanceCullDistance);
+		Instances->SetupAttachment(GetRootComponent());
+		Instances->RegisterComponent();
+	}
+
+	if (Record.InstanceIndex != INDEX_NONE)
+	{
+		Instances->UpdateInstanceTransform(Record.InstanceIndex, Record.GetTransform(), true, true);
+		return;
+	}
+
+	TArray<int32>* MeshFreeInstances = FreeInstances.Find(Mesh);
+
+	if (MeshFreeInstances && MeshFreeInstances->Num())
+	{
+		Record.InstanceIndex = MeshFreeInstances->Pop(false);
+		Instances->UpdateInstanceTransform(Record.InstanceIndex, Record.GetTransform(), true, true);
+	}
+	else
+	{
+		Record.InstanceIndex = Instances->AddInstance(Record.GetTransform(), true);
+	}
+
+	Record.InstanceMesh = Mesh;
+}
+
+void ALootField::HideInstance(FLootFieldRecord& Record)
+{
+	if (!Record.InstanceMesh || Record.InstanceIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	/**Removing an instance renumbers every instance after it, so instead we shrink it away and keep the slot for the next record
+	that needs this mesh*/
+	if (UInstancedStaticMeshComponent* Instances = MeshInstances.FindRef(Record.InstanceMesh))
+	{
+		Instances->UpdateInstanceTransform(Record.InstanceIndex, FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), true, true);
+		FreeInstances.FindOrAdd(Record.InstanceMesh).Add(Record.InstanceIndex);
+	}
+
+	Record.InstanceMesh = nullptr;
+	Record.InstanceIndex = INDEX_NONE;
+}
@@ -0,0 +1,166 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Engine/NetSerialization.h"
+#include "LootField.generated.h"
+
+/**A pickup lying in a loot field, as just where it is and what it is. Records with no item class are free slots waiting to
+be reused, so a record's index never changes while it's in use.*/
+USTRUCT()
+struct FLootFieldRecord : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FVector_NetQuantize Location;
+
+	//Yaw compressed to a short, pickups lie flat
+	UPROPERTY()
+	uint16 Yaw = 0;
+
+	UPROPERTY()
+	TSubclassOf<class UItem> ItemClass;
+
+	UPROPERTY()
+	int32 Quantity = 0;
+
+	//Whether a real pickup actor is standing in for this record at the moment, in which case we don't draw it
+	UPROPERTY()
+	bool bPromoted = false;
+
+	//[Client] The instance drawing this record, if any. Never replicated
+	UPROPERTY(NotReplicated)
+	class UStaticMesh* InstanceMesh = nullptr;
+
+	UPROPERTY(NotReplicated)
+	int32 InstanceIndex = INDEX_NONE;
+
+	//[Server] The item spawn this loot came from, told when it's taken. Never replicated
+	UPROPERTY(NotReplicated)
+	int32 SpawnIndex = INDEX_NONE;
+
+	bool IsInUse() const { return ItemClass != nullptr; }
+
+	FTransform GetTransform() const;
+
+	//Client side callbacks, called by the fast array serializer
+	void PreReplicatedRemove(const struct FLootFieldRecordList& InArraySerializer);
+	void PostReplicatedAdd(const struct FLootFieldRecordList& InArraySerializer);
+	void PostReplicatedChange(const struct FLootFieldRecordList& InArraySerializer);
+};
+
+USTRUCT()
+struct FLootFieldRecordList : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FLootFieldRecord> Records;
+
+	//The field that owns this list. Set in the field constructor, never replicated.
+	class ALootField* OwnerField = nullptr;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+};
+
+template<>
+struct TStructOpsTypeTraits<FLootFieldRecordList> : public TStructOpsTypeTraitsBase2<FLootFieldRecordList>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
+/**
+ * Holds loot lying around the world without an actor per pickup. Loot is kept as compact records and drawn on clients with
+ * one instanced static mesh per item mesh. When a player gets close to some loot the server swaps in a real pickup actor
+ * they can interact with, and swaps it back out for a record once nobody is near it any more.
+ *
+ * A field is always relevant and sends every record to a joining client in one go, so it holds at most MaxRecords. Split bigger
+ * levels into several fields, one per region, rather than letting one field grow.
+ */
+UCLASS()
+class SURVIVALGAME_API ALootField : public AActor
+{
+	GENERATED_BODY()
+
+	friend struct FLootFieldRecord;
+
+public:
+
+	ALootField();
+
+	//Most records a field can hold. Kept well under the 2048 changes a fast array can send in one update
+	static constexpr int32 MaxRecords = 1024;
+
+	/**[Server] Put some loot in the field. The item spawn at SpawnIndex, if any, is told when it's taken. Returns the record
+	the loot went in, or INDEX_NONE if it couldn't be added, ie because the field is full*/
+	int32 AddLoot(const TSubclassOf<class UItem> ItemClass, const int32 Quantity, const FTransform& Transform, const int32 SpawnIndex = INDEX_NONE);
+
+	//[Server] Take loot back out of the field, ie because its pickup was taken
+	void RemoveLoot(const int32 RecordIndex);
+
+	int32 GetNumLoot() const { return Loot.Records.Num() - FreeRecords.Num(); }
+
+	//The pickup spawned when a player gets close to some loot
+	UPROPERTY(EditAnywhere, Category = "Loot")
+	TSubclassOf<class APickup> PickupClass;
+
+	//How close a player has to get to loot for it to become a real pickup. Should be a fair bit more than the interaction distance
+	UPROPERTY(EditAnywhere, Category = "Loot")
+	float PromotionRadius;
+
+	//How far every player has to be from a pickup before it goes back to being a record. Larger than PromotionRadius so it doesn't flicker
+	UPROPERTY(EditAnywhere, Category = "Loot")
+	float DemotionRadius;
+
+	//How often the server looks for loot to promote or demote, in seconds
+	UPROPERTY(EditAnywhere, Category = "Loot")
+	float PromotionCheckInterval;
+
+	//How far away clients stop drawing loot. Zero to draw it at any distance
+	UPROPERTY(EditAnywhere, Category = "Loot")
+	float InstanceCullDistance;
+
+protected:
+
+	virtual void BeginPlay() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	UPROPERTY(Replicated)
+	FLootFieldRecordList Loot;
+
+	//[Server] Swap a record for a pickup actor, and back
+	void Promote(const int32 RecordIndex);
+	void Demote(class APickup* Pickup, const int32 RecordIndex);
+
+	//[Server] Players look for loot within the cells around them
+	void UpdatePromotions();
+
+	UFUNCTION()
+	void OnPromotedPickupDestroyed(AActor* DestroyedActor);
+
+	//Show, move or hide a record's instance to match the record. Does nothing on dedicated servers
+	void RefreshInstance(FLootFieldRecord& Record);
+	void HideInstance(FLootFieldRecord& Record);
+
+	FIntPoint GetCell(const FVector& Location) const;
+
+	//[Server] Cell -> records in it, records that can be reused, and the pickups currently standing in for records
+	TMap<FIntPoint, TArray<int32>> Cells;
+	TArray<int32> FreeRecords;
+	TMap<class APickup*, int32> PromotedPickups;
+
+	//[Client] One instanced mesh per item mesh, and the instances in each that are hidden and can be reused
+	UPROPERTY(Transient)
+	TMap<class UStaticMesh*, class UInstancedStaticMeshComponent*> MeshInstances;
+
+	TMap<const class UStaticMesh*, TArray<int32>> FreeInstances;
+
+	float TimeSincePromotionCheck;
+};
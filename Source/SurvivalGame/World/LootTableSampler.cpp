@@ -0,0 +1,159 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SurvivalGame/World/LootTableSampler.h"
+#include "SurvivalGame/World/ItemSpawn.h"
+#include "Engine/DataTable.h"
+
+namespace LootTableSampler
+{
+	struct FCacheEntry
+	{
+		TUniquePtr<FLootTableSampler> Sampler;
+		FDelegateHandle TableChangedHandle;
+	};
+
+	//Samplers are only ever built and used on the game thread
+	TMap<TWeakObjectPtr<const UDataTable>, FCacheEntry>& GetCache()
+	{
+		static TMap<TWeakObjectPtr<const UDataTable>, FCacheEntry> Cache;
+		return Cache;
+	}
+}
+
+const FLootTableSampler* FLootTableSampler::Get(const UDataTable* LootTable)
+{
+	check(IsInGameThread());
+
+	if (!LootTable || !LootTable->GetRowStruct() || !LootTable->GetRowStruct()->IsChildOf(FLootTableRow::StaticStruct()))
+	{
+		return nullptr;
+	}
+
+	auto& Cache = LootTableSampler::GetCache();
+
+	if (LootTableSampler::FCacheEntry* Entry = Cache.Find(LootTable))
+	{
+		return Entry->Sampler->Rows.Num() ? Entry->Sampler.Get() : nullptr;
+	}
+
+	LootTableSampler::FCacheEntry& NewEntry = Cache.Add(LootTable);
+	NewEntry.Sampler = TUniquePtr<FLootTableSampler>(new FLootTableSampler(LootTable));
+
+	//The sampler points straight at the table rows, so it has to go as soon as the table is edited or reimported
+	TWeakObjectPtr<const UDataTable> WeakTable(LootTable);
+	NewEntry.TableChangedHandle = const_cast<UDataTable*>(LootTable)->OnDataTableChanged().AddLambda([WeakTable]()
+	{
+		LootTableSampler::FCacheEntry Removed;
+
+		if (LootTableSampler::GetCache().RemoveAndCopyValue(WeakTable, Removed))
+		{
+			if (UDataTable* Table = const_cast<UDataTable*>(WeakTable.Get()))
+			{
+				Table->OnDataTableChanged().Remove(Removed.TableChangedHandle);
+			}
+		}
+	});
+
+	return NewEntry.Sampler->Rows.Num() ? NewEntry.Sampler.Get() : nullptr;
+}
+
+FLootTableSampler::FLootTableSampler(const UDataTable* LootTable)
+{
+	TArray<FLootTableRow*> TableRows;
+	LootTable->GetAllRows("", TableRows);
+
+	for (const FLootTableRow* Row : TableRows)
+	{
+		if (Row)
+		{
+			Rows.Add(Row);
+		}
+	}
+
+	const int32 NumRows = Rows.Num();
+
+	if (!NumRows)
+	{
+		return;
+	}
+
+	double TotalProbability = 0.0;
+
+	for (const FLootTableRow* Row : Rows)
+	{
+		TotalProbability += FMath::Max(Row->Probability, 0.f);
+	}
+
+	KeepChances.SetNumUninitialized(NumRows);
+	Aliases.SetNumUninitialized(NumRows);
+
+	//Scale the probabilities so they average out to 1, then split them into the columns under and over that
+	TArray<double> Scaled;
+	Scaled.SetNumUninitialized(NumRows);
+
+	TArray<int32> Small;
+	TArray<int32> Large;
+
+	for (int32 i = 0; i < NumRows; ++i)
+	{
+		Scaled[i] = TotalProbability > 0.0 ? FMath::Max(Rows[i]->Probability, 0.f) * NumRows / TotalProbability : 1.0;
+		Aliases[i] = i;
+
+		if (Scaled[i] < 1.0)
+		{
+			Small.Add(i);
+		}
+		else
+		{
+			Large.Add(i);
+		}
+	}
+
+	//Top up each small column with some of a large one
+	while (Small.Num() && Large.Num())
+	{
+		const int32 Less = Small.Pop(false);
+		const int32 More = Large.Pop(false);
+
+		KeepChances[Less] = (float)Scaled[Less];
+		Aliases[Less] = More;
+
+		Scaled[More] = (Scaled[More] + Scaled[Less]) - 1.0;
+
+		if (Scaled[More] < 1.0)
+		{
+			Small.Add(More);
+		}
+		else
+		{
+			Large.Add(More);
+		}
+	}
+
+	//Whatever is left over is only off by rounding error
+	for (const int32 i : Large)
+	{
+		KeepChances[i] = 1.f;
+	}
+
+	for (const int32 i : Small)
+	{
+		KeepChances[i] = 1.f;
+	}
+}
+
+const FLootTableRow* FLootTableSampler::PickRow() const
+{
+	return Rows.Num() ? PickRow(FMath::RandRange(0, Rows.Num() - 1), FMath::FRand()) : nullptr;
+}
+
+const FLootTableRow* FLootTableSampler::PickRow(const FRandomStream& Stream) const
+{
+	return Rows.Num() ? PickRow(Stream.RandRange(0, Rows.Num() - 1), Stream.FRand()) : nullptr;
+}
+
+const FLootTableRow* FLootTableSampler::PickRow(const int32 Column, const float Roll) const
+{
+	return Roll < KeepChances[Column] ? Rows[Column] : Rows[Aliases[Column]];
+}
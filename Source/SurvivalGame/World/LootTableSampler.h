@@ -0,0 +1,40 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FLootTableRow;
+class UDataTable;
+
+/**
+ * A loot table compiled into an alias table, so picking a row costs the same no matter how the probabilities are spread.
+ * Rows come out with the same odds as picking a random row and re-rolling until its Probability check passes, 
+ * which is what the item spawns and chests used to do.
+ */
+class SURVIVALGAME_API FLootTableSampler
+{
+public:
+
+	/**Get the sampler for a loot table, building it the first time it's asked for. 
+	The sampler is thrown away whenever the table changes, so don't hold on to it. Returns nullptr if the table has no loot rows.*/
+	static const FLootTableSampler* Get(const UDataTable* LootTable);
+
+	//Pick a row using the global random number generator
+	const FLootTableRow* PickRow() const;
+
+	//Pick a row using the given stream, ie so a chest can roll the same loot from the same seed
+	const FLootTableRow* PickRow(const FRandomStream& Stream) const;
+
+private:
+
+	explicit FLootTableSampler(const UDataTable* LootTable);
+
+	const FLootTableRow* PickRow(const int32 Column, const float Roll) const;
+
+	TArray<const FLootTableRow*> Rows;
+
+	//The chance of keeping each column's own row, otherwise we use the row in Aliases
+	TArray<float> KeepChances;
+	TArray<int32> Aliases;
+};
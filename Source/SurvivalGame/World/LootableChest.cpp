@@ -7,6 +7,7 @@
 #include "Components/StaticMeshComponent.h"
 #include "Engine/DataTable.h"
 #include "SurvivalGame/World/ItemSpawn.h"
+#include "SurvivalGame/World/LootTableSampler.h"
 #include "SurvivalGame/Items/Item.h"
 #include "SurvivalGame/Player/SurvivalCharacter.h"
 
@@ -27,10 +28,19 @@ ALootableChest::ALootableChest()
 	Inventory = CreateDefaultSubobject<UInventoryComponent>("Inventory");
 	Inventory->SetCapacity(20);
 	Inventory->SetWeightCapacity(80.f);
+	Inventory->SetUseItemInstances(true);
 
 	LootRolls = FIntPoint(2, 8);
+	bDeferLootGeneration = true;
+	LootSeed = 0;
+	bLootGenerated = false;
 
 	SetReplicates(true);
+	bReplicateUsingRegisteredSubObjectList = true;
+
+	/**Placed chests exist on clients already, so there's nothing to send until loot is generated or someone loots them. 
+	The inventory wakes us while we're being looted and puts us back to sleep afterwards.*/
+	NetDormancy = DORM_Initial;
 }
 
 // Called when the game starts or when spawned
@@ -40,26 +50,53 @@ void ALootableChest::BeginPlay()
 
 	LootInteraction->OnInteract.AddDynamic(this, &ALootableChest::OnInteract);
 
-	if (HasAuthority() && LootTable)
+	if (HasAuthority())
 	{
-		TArray<FLootTableRow*> SpawnItems;
-		LootTable->GetAllRows("", SpawnItems);
+		if (LootSeed == 0)
+		{
+			LootSeed = FMath::Rand();
+		}
 
-		int32 Rolls = FMath::RandRange(LootRolls.GetMin(), LootRolls.GetMax());
+		if (bDeferLootGeneration)
+		{
+			/**Nothing to send until there's loot in it. The loot is rolled as soon as a player starts opening the chest, 
+			which the server only hears about once they're in range, so it's ready by the time the interaction finishes*/
+			Inventory->SetIsReplicated(false);
 
-		for (int32 i = 0; i < Rolls; ++i)
+			LootInteraction->OnBeginInteract.AddDynamic(this, &ALootableChest::OnBeginInteract);
+		}
+		else
 		{
-			const FLootTableRow* LootRow = SpawnItems[FMath::RandRange(0, SpawnItems.Num() - 1)];
+			GenerateLoot();
+		}
+	}
+}
 
-			ensure(LootRow);
+void ALootableChest::GenerateLoot()
+{
+	if (!HasAuthority() || bLootGenerated)
+	{
+		return;
+	}
 
-			float ProbabilityRoll = FMath::FRandRange(0.f, 1.f);
+	bLootGenerated = true;
+	Inventory->SetIsReplicated(true);
 
-			while (ProbabilityRoll > LootRow->Probability)
-			{
-				LootRow = SpawnItems[FMath::RandRange(0, SpawnItems.Num() - 1)];
-				ProbabilityRoll = FMath::FRandRange(0.f, 1.f);
-			}
+	if (const FLootTableSampler* LootSampler = FLootTableSampler::Get(LootTable))
+	{
+		//Rolling from the chests own seed means the loot comes out the same no matter when it's generated
+		FRandomStream LootStream(LootSeed);
+
+		int32 Rolls = LootStream.RandRange(LootRolls.GetMin(), LootRolls.GetMax());
+
+		//Roll everything first, then add it in one batch so the chest only replicates its contents once
+		TArray<FItemAddRequest> LootRequests;
+
+		for (int32 i = 0; i < Rolls; ++i)
+		{
+			const FLootTableRow* LootRow = LootSampler->PickRow(LootStream);
+
+			ensure(LootRow);
 
 			if (LootRow && LootRow->Items.Num())
 			{
@@ -68,20 +105,31 @@ void ALootableChest::BeginPlay()
 					if (ItemClass)
 					{
 						const int32 Quantity = Cast<UItem>(ItemClass->GetDefaultObject())->GetQuantity();
-						Inventory->TryAddItemFromClass(ItemClass, Quantity);
+						LootRequests.Add(FItemAddRequest(ItemClass, Quantity));
 					}
 				}
 			}
 		}
+
+		Inventory->TryAddItems(LootRequests);
 	}
+
+	//Instances aren't subobjects so adding them doesn't wake us by itself
+	FlushNetDormancy();
 }
 
 void ALootableChest::OnInteract(class ASurvivalCharacter* Character)
 {
 	if (Character)
 	{
+		GenerateLoot();
 		Character->SetLootSource(Inventory);
 	}
 }
 
+void ALootableChest::OnBeginInteract(class ASurvivalCharacter* Character)
+{
+	GenerateLoot();
+}
+
 #undef LOCTEXT_NAMESPACE
\ No newline at end of file
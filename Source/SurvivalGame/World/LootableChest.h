@@ -32,6 +32,18 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
 		FIntPoint LootRolls;
 
+	/**If true, the loot isn't rolled until a player starts opening the chest. 
+	Most chests are never opened, so this saves creating their items at all.*/
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+		bool bDeferLootGeneration;
+
+	//The seed the loot is rolled from. Leave at zero to pick a random seed when the match starts
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+		int32 LootSeed;
+
+	//[Server] Roll the loot table and fill the inventory, if we haven't already
+	void GenerateLoot();
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
@@ -39,4 +51,10 @@ protected:
 	UFUNCTION()
 		void OnInteract(class ASurvivalCharacter* Character);
 
+	UFUNCTION()
+		void OnBeginInteract(class ASurvivalCharacter* Character);
+
+	UPROPERTY()
+		bool bLootGenerated;
+
 };
\ No newline at end of file
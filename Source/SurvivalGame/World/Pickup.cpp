@@ -9,7 +9,12 @@
 #include "Components/StaticMeshComponent.h"
 #include "SurvivalGame/Components/InteractionComponent.h"
 #include "SurvivalGame/Components/InventoryComponent.h"
-#include "Engine/ActorChannel.h"
+#include "SurvivalGame/Items/AmmoItem.h"
+#include "SurvivalGame/World/ItemSpawnSubsystem.h"
+#include "SurvivalGame/World/LootField.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
 
 // Sets default values
 APickup::APickup()
@@ -28,14 +33,28 @@ APickup::APickup()
 	InteractionComponent->SetupAttachment(PickupMesh);
 
 	SetReplicates(true);
+	bReplicateUsingRegisteredSubObjectList = true;
+
+	/**Pickups only change when they're taken or dropped, so after their first update they stay dormant until their item changes. 
+	Not DORM_Initial, placed pickups still need to send clients the item they create at BeginPlay. Destroying a dormant pickup 
+	still closes it on clients.*/
+	NetDormancy = DORM_DormantAll;
+
+	SpawnIndex = INDEX_NONE;
 }
 
 void APickup::InitializePickup(const TSubclassOf<class UItem> ItemClass, const int32 Quantity)
 {
 	if (HasAuthority() && ItemClass && Quantity > 0)
 	{
+		if (Item)
+		{
+			RemoveReplicatedSubObject(Item);
+		}
+
 		Item = NewObject<UItem>(this, ItemClass);
 		Item->SetQuantity(Quantity);
+		AddReplicatedSubObject(Item);
 
 		OnRep_Item();
 
@@ -96,16 +115,18 @@ void APickup::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeP
 	DOREPLIFETIME(APickup, Item);
 }
 
-bool APickup::ReplicateSubobjects(UActorChannel* Channel, FOutBunch* Bunch, FReplicationFlags* RepFlags)
+void APickup::Destroyed()
 {
-	bool bWroteSomething = Super::ReplicateSubobjects(Channel, Bunch, RepFlags);
-
-	if (Item && Channel->KeyNeedsToReplicate(Item->GetUniqueID(), Item->RepKey))
+	//Pickups only get destroyed once they've been taken
+	if (HasAuthority() && SpawnIndex != INDEX_NONE)
 	{
-		bWroteSomething |= Channel->ReplicateSubobject(Item, *Bunch, *RepFlags);
+		if (UItemSpawnSubsystem* ItemSpawnSubsystem = GetWorld()->GetSubsystem<UItemSpawnSubsystem>())
+		{
+			ItemSpawnSubsystem->OnLootTaken(SpawnIndex);
+		}
 	}
 
-	return bWroteSomething;
+	Super::Destroyed();
 }
 
 #if WITH_EDITOR
@@ -139,9 +160,16 @@ void APickup::OnTakePickup(ASurvivalCharacter* Taker)
 	{
 		if (UInventoryComponent* PlayerInventory = Taker->PlayerInventory)
 		{
-			const FItemAddResult AddResult = PlayerInventory->TryAddItem(Item);
+			//If the whole item fits it gets moved into the inventory as is, rather than copied
+			const FItemAddResult AddResult = PlayerInventory->TryMoveItem(Item);
 
-			if (AddResult.AmountGiven < Item->GetQuantity())
+			if (Item->OwningInventory == PlayerInventory)
+			{
+				RemoveReplicatedSubObject(Item);
+				Item = nullptr;
+				Destroy();
+			}
+			else if (AddResult.AmountGiven < Item->GetQuantity())
 			{
 				Item->SetQuantity(Item->GetQuantity() - AddResult.AmountGiven);
 			}
@@ -152,3 +180,98 @@ void APickup::OnTakePickup(ASurvivalCharacter* Taker)
 		}
 	}
 }
+
+#if !UE_BUILD_SHIPPING
+/**Spawn a grid of pickups around the first local player, to measure what replicating lots of pickups costs with stat net, 
+stat game or Insights. With InField set the loot goes in a loot field instead, the first one in the level or a new one, so the 
+two can be compared. Usage: Survival.Debug.SpawnPickups [Count] [Spacing] [InField]*/
+static void SpawnStressPickups(const TArray<FString>& Args, UWorld* World)
+{
+	if (!World || World->GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	const int32 Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 500;
+	const float Spacing = Args.Num() > 1 ? FCString::Atof(*Args[1]) : 150.f;
+	const bool bInField = Args.Num() > 2 && FCString::Atoi(*Args[2]) != 0;
+
+	APlayerController* PC = World->GetFirstPlayerController();
+	ASurvivalCharacter* Character = PC ? Cast<ASurvivalCharacter>(PC->GetPawn()) : nullptr;
+
+	if (!Character || !Character->PickupClass)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Survival.Debug.SpawnPickups needs a local player with a pickup class set."));
+		return;
+	}
+
+	ALootField* LootField = nullptr;
+
+	if (bInField)
+	{
+		TActorIterator<ALootField> It(World);
+		LootField = It ? *It : World->SpawnActor<ALootField>();
+
+		if (!LootField)
+		{
+			return;
+		}
+
+		if (!LootField->PickupClass)
+		{
+			LootField->PickupClass = Character->PickupClass;
+		}
+	}
+
+	//Use whatever the player is carrying so the pickups look like real ones, or plain ammo if they have nothing
+	TArray<TSubclassOf<UItem>> ItemClasses;
+
+	for (UItem* InvItem : Character->PlayerInventory->GetItems())
+	{
+		ItemClasses.AddUnique(InvItem->GetClass());
+	}
+
+	if (!ItemClasses.Num())
+	{
+		ItemClasses.Add(UAmmoItem::StaticClass());
+	}
+
+	const int32 Side = FMath::CeilToInt(FMath::Sqrt((float)Count));
+	const FVector Origin = Character->GetActorLocation() - FVector(Side * Spacing * 0.5f, Side * Spacing * 0.5f, 0.f);
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.bNoFail = true;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+	//Stop at the field's limit instead of tripping its ensure for every record past it
+	const int32 NumToSpawn = LootField ? FMath::Min(Count, ALootField::MaxRecords - LootField->GetNumLoot()) : Count;
+
+	for (int32 i = 0; i < NumToSpawn; ++i)
+	{
+		const FVector Location = Origin + FVector((i % Side) * Spacing, (i / Side) * Spacing, 0.f);
+
+		if (LootField)
+		{
+			LootField->AddLoot(ItemClasses[i % ItemClasses.Num()], 1, FTransform(Location));
+		}
+		else if (APickup* Pickup = World->SpawnActor<APickup>(Character->PickupClass, FTransform(Location), SpawnParams))
+		{
+			Pickup->InitializePickup(ItemClasses[i % ItemClasses.Num()], 1);
+		}
+	}
+
+	if (LootField)
+	{
+		UE_LOG(LogTemp, Display, TEXT("Added %d loot to %s, which now holds %d."), NumToSpawn, *LootField->GetName(), LootField->GetNumLoot());
+	}
+	else
+	{
+		UE_LOG(LogTemp, Display, TEXT("Spawned %d pickups."), NumToSpawn);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs SpawnStressPickupsCmd(
+	TEXT("Survival.Debug.SpawnPickups"),
+	TEXT("Spawn a grid of pickups around the player, or put them in a loot field, for profiling replication. Usage: Survival.Debug.SpawnPickups [Count] [Spacing] [InField]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SpawnStressPickups));
+#endif
@@ -22,6 +22,11 @@ public:
 	UFUNCTION(BlueprintImplementableEvent)
 	void AlignWithGround();
 
+	FORCEINLINE class UItem* GetItem() const { return Item; }
+
+	//[Server] The item spawn this pickup came from, if any, which is told when it's taken
+	int32 SpawnIndex;
+
 	//This is used as a template to create the pickup when spawned in
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Instanced)
 	class UItem* ItemTemplate;
@@ -41,7 +46,7 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
-	virtual bool ReplicateSubobjects(class UActorChannel* Channel, class FOutBunch* Bunch, FReplicationFlags* RepFlags) override;
+	virtual void Destroyed() override;
 
 #if WITH_EDITOR
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
@@ -11,6 +11,9 @@ public class SurvivalGameEditorTarget : TargetRules
 
 		ExtraModuleNames.AddRange( new string[] { "SurvivalGame" } );
 
+		// Push model replication is compiled out unless the target asks for it, which would turn every MARK_PROPERTY_DIRTY into a no-op
+		bWithPushModel = true;
+
 		// Suppress upgrade message
 		DefaultBuildSettings = BuildSettingsVersion.V2;
 